@@ -2,6 +2,7 @@
 #define RTC_REMOVE 1
 #define RTC_FIND 2
 #define RTC_SYNC 3
+#define RTC_ADD_BATCH 4
 
 struct mp1_blink_struct {
   unsigned short location;
@@ -13,3 +14,9 @@ struct mp1_blink_struct {
   unsigned short status;
   struct mp1_blink_struct* next;
 } __attribute((packed)); 
+
+/* Argument to RTC_ADD_BATCH, which adds count blinks at once */
+struct mp1_blink_batch {
+  unsigned long count;
+  struct mp1_blink_struct* blinks;
+};
@@ -5,6 +5,10 @@
 
 #define NULL 0
 #define WAIT 100
+
+/* Enough for both frames to blink in every cell, twice over */
+#define MAX_BLINKS 4096
+
 uint8_t *vmem_base_addr;
 uint8_t *mp1_set_video_mode (void);
 void add_frames(uint8_t *, uint8_t *, int32_t);
@@ -18,14 +22,22 @@ uint8_t file1[] = "frame1.txt";
 extern int mp1_ioctl(unsigned long arg, unsigned long cmd);
 extern void mp1_rtc_tasklet(unsigned long trash);
 
-static struct mp1_blink_struct blink_array[80*25];
+/* Blinks are allocated from a pool, with the free ones linked by next */
+static struct mp1_blink_struct blink_pool[MAX_BLINKS];
+static struct mp1_blink_struct *free_blinks;
+
+/* Blinks read from the frame files, added in one batch */
+static struct mp1_blink_struct frame_blinks[MAX_BLINKS];
 
 int main(void)
 {
     int rtc_fd, ret_val, i, garbage;
     struct mp1_blink_struct blink_struct;
 
-    ece391_memset(blink_array, 0, sizeof(struct mp1_blink_struct)*80*25);
+    for(i=0; i<MAX_BLINKS; i++) {
+        blink_pool[i].next = free_blinks;
+        free_blinks = &blink_pool[i];
+    }
 
     if(mp1_set_video_mode() == NULL) {
         return -1;
@@ -80,11 +92,12 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 {
     int32_t row, col, offset = 40, eof0 = 0, eof1 = 0, num_bytes;
     int32_t fd0, fd1;
-    struct mp1_blink_struct blink_struct;
+    struct mp1_blink_batch batch;
+    struct mp1_blink_struct *blink_struct;
     uint8_t c0 = '0', c1 = '0';
 
-    blink_struct.on_length = 15;
-    blink_struct.off_length = 15;
+    batch.count = 0;
+    batch.blinks = frame_blinks;
 
     row = 0;
 
@@ -119,11 +132,14 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
                 break;
 
             } else {
-                if((c0 != ' ' && c0 != '\n') || (c1 != ' ' && c1 != '\n')) {
-                    blink_struct.on_char = ( (c0 == '\n') ? ' ' : c0);
-                    blink_struct.off_char = ( (c1 == '\n') ? ' ' : c1);
-                    blink_struct.location = row*80 + col + offset;
-                    mp1_ioctl((unsigned long)&blink_struct, RTC_ADD);
+                if(((c0 != ' ' && c0 != '\n') || (c1 != ' ' && c1 != '\n')) &&
+                   batch.count < MAX_BLINKS) {
+                    blink_struct = &frame_blinks[batch.count++];
+                    blink_struct->on_char = ( (c0 == '\n') ? ' ' : c0);
+                    blink_struct->off_char = ( (c1 == '\n') ? ' ' : c1);
+                    blink_struct->location = row*80 + col + offset;
+                    blink_struct->on_length = 15;
+                    blink_struct->off_length = 15;
                 }
             }
             col++;
@@ -145,6 +161,8 @@ add_frames(uint8_t *f0, uint8_t *f1, int32_t rtc_fd)
 
         row++;
     }
+
+    mp1_ioctl((unsigned long)&batch, RTC_ADD_BATCH);
 }
 
 uint8_t*
@@ -159,19 +177,20 @@ mp1_set_video_mode (void)
 
 void* mp1_malloc(int32_t size)
 {
-    int32_t i;
-    for(i=0; i< 80*25; i++) {
-        if(blink_array[i].location == 0) {
-            return &blink_array[i];
-        }
+    struct mp1_blink_struct *blink = free_blinks;
+    if(blink != NULL) {
+        free_blinks = blink->next;
     }
 
-    return NULL;
+    return blink;
 }
 
 void mp1_free(void* memory)
 {
-    ece391_memset(memory, 0, sizeof(struct mp1_blink_struct));
+    struct mp1_blink_struct *blink = memory;
+    ece391_memset(blink, 0, sizeof(struct mp1_blink_struct));
+    blink->next = free_blinks;
+    free_blinks = blink;
 }
 
 void ece391_memset(void* memory, char c, int n)
@@ -10,7 +10,6 @@ fi
 
 # Make binaries executable
 chmod +x "${mp3_dir}/createfs"
-chmod +x "${mp3_dir}/elfconvert"
 
 # Compile userspace programs
 make -C "${mp3_dir}/syscalls"
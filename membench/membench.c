@@ -0,0 +1,372 @@
+/*
+ * Benchmark for the kernel's memory functions (student-distrib/lib.c).
+ *
+ * This is a Linux program: it links the kernel's lib.c directly and
+ * times memcpy, memmove and memset against the rep movsl/stosl
+ * versions they replaced, which are copied below. The output is the
+ * table at the top of the memory functions in lib.c.
+ *
+ * Each entry is the best of BENCH_RUNS runs, in TSC cycles. "hot"
+ * runs repeat on the same buffers, so everything up to the size of
+ * the cache is already in it. "cold" runs flush the destination out
+ * of the cache first, which is what clearing a process page in
+ * process_load_exe looks like.
+ */
+#include "types.h"
+#include "lib.h"
+
+/* Number of runs to take the best of */
+#define BENCH_RUNS 50
+
+/* Size of the largest buffer */
+#define BENCH_MAX_SIZE 0x400000
+
+/* Size of a cache line, for clflush */
+#define CACHE_LINE_SIZE 64
+
+/* Linux i386 syscall numbers */
+#define LINUX_SYS_EXIT  1
+#define LINUX_SYS_WRITE 4
+
+/* Sizes to test */
+static const uint32_t bench_sizes[] = {
+    16, 64, 256, 0x1000, 0x10000, 0x100000, 0x400000,
+};
+
+/* Buffers, with some slack for the overlapping memmove */
+static uint8_t bench_src[BENCH_MAX_SIZE + 64] __attribute__((aligned(64)));
+static uint8_t bench_dest[BENCH_MAX_SIZE + 64] __attribute__((aligned(64)));
+
+/* Output buffer for terminal_putc */
+static uint8_t out_buf[4096];
+static uint32_t out_len = 0;
+
+/* Makes a Linux syscall */
+static int32_t
+linux_syscall(int32_t num, int32_t a, int32_t b, int32_t c)
+{
+    int32_t ret;
+    asm volatile("int $0x80"
+                 : "=a"(ret)
+                 : "a"(num), "b"(a), "c"(b), "d"(c)
+                 : "memory");
+    return ret;
+}
+
+/* Writes out everything printed so far */
+static void
+out_flush(void)
+{
+    linux_syscall(LINUX_SYS_WRITE, 1, (int32_t)out_buf, out_len);
+    out_len = 0;
+}
+
+/* lib.c prints through the terminal; send it to stdout instead */
+void
+terminal_putc(uint8_t c)
+{
+    if (out_len == sizeof(out_buf)) {
+        out_flush();
+    }
+    out_buf[out_len++] = c;
+}
+
+/* Not used by the memory functions */
+void
+terminal_clear(void)
+{
+}
+
+/* Not used by the memory functions */
+uint32_t
+paging_user_extent(uint32_t start, uint32_t end, bool write)
+{
+    return 0;
+}
+
+/* Reads the TSC, waiting for earlier instructions to finish first */
+static uint64_t
+rdtsc(void)
+{
+    uint64_t tsc;
+    asm volatile("lfence; rdtsc" : "=A"(tsc) : : "memory");
+    return tsc;
+}
+
+/* Flushes a buffer out of every level of the cache */
+static void
+flush_cache(const uint8_t *buf, uint32_t n)
+{
+    uint32_t i;
+    for (i = 0; i < n; i += CACHE_LINE_SIZE) {
+        asm volatile("clflush (%0)" : : "r"(buf + i) : "memory");
+    }
+    asm volatile("mfence" : : : "memory");
+}
+
+/* The memcpy that was replaced: align dest, then rep movsl */
+static void
+old_memcpy(void *dest, const void *src, uint32_t n)
+{
+    asm volatile("                  \n\
+            1:                      \n\
+            testl   %%ecx, %%ecx    \n\
+            jz      4f              \n\
+            testl   $0x3, %%edi     \n\
+            jz      2f              \n\
+            movsb                   \n\
+            subl    $1, %%ecx       \n\
+            jmp     1b              \n\
+            2:                      \n\
+            movl    %%ecx, %%edx    \n\
+            shrl    $2, %%ecx       \n\
+            andl    $0x3, %%edx     \n\
+            cld                     \n\
+            rep     movsl           \n\
+            movl    %%edx, %%ecx    \n\
+            rep     movsb           \n\
+            4:                      \n\
+            "
+            : "+D"(dest), "+S"(src), "+c"(n)
+            :
+            : "edx", "memory", "cc"
+            );
+}
+
+/* The memmove that was replaced: std; rep movsb when dest > src */
+static void
+old_memmove(void *dest, const void *src, uint32_t n)
+{
+    asm volatile("                  \n\
+            cld                     \n\
+            cmp     %%edi, %%esi    \n\
+            jae     1f              \n\
+            leal    -1(%%esi, %%ecx), %%esi    \n\
+            leal    -1(%%edi, %%ecx), %%edi    \n\
+            std                     \n\
+            1:                      \n\
+            rep     movsb           \n\
+            cld                     \n\
+            "
+            : "+D"(dest), "+S"(src), "+c"(n)
+            :
+            : "memory", "cc"
+            );
+}
+
+/* The memset that was replaced: align s, then rep stosl */
+static void
+old_memset(void *s, int32_t c, uint32_t n)
+{
+    c &= 0xFF;
+    asm volatile("                  \n\
+            cld                     \n\
+            1:                      \n\
+            testl   %%ecx, %%ecx    \n\
+            jz      2f              \n\
+            testl   $0x3, %%edi     \n\
+            jz      2f              \n\
+            stosb                   \n\
+            subl    $1, %%ecx       \n\
+            jmp     1b              \n\
+            2:                      \n\
+            movl    %%ecx, %%edx    \n\
+            shrl    $2, %%ecx       \n\
+            andl    $0x3, %%edx     \n\
+            rep     stosl           \n\
+            movl    %%edx, %%ecx    \n\
+            rep     stosb           \n\
+            "
+            : "+D"(s), "+c"(n)
+            : "a"(c << 24 | c << 16 | c << 8 | c)
+            : "edx", "memory", "cc"
+            );
+}
+
+/*
+ * A memset with non-temporal stores, which lib.c used to use for
+ * fills of 1MB and up. It's kept here so that decision can be
+ * checked again.
+ */
+static void
+nt_memset(void *s, int32_t c, uint32_t n)
+{
+    c &= 0xFF;
+    asm volatile("                  \n\
+            1:                      \n\
+            testl   $0xf, %%edi     \n\
+            jz      2f              \n\
+            movb    %%al, (%%edi)   \n\
+            addl    $1, %%edi       \n\
+            subl    $1, %%ecx       \n\
+            jmp     1b              \n\
+            2:                      \n\
+            movl    %%ecx, %%edx    \n\
+            shrl    $4, %%ecx       \n\
+            andl    $0xf, %%edx     \n\
+            3:                      \n\
+            movnti  %%eax, 0(%%edi) \n\
+            movnti  %%eax, 4(%%edi) \n\
+            movnti  %%eax, 8(%%edi) \n\
+            movnti  %%eax, 12(%%edi) \n\
+            addl    $16, %%edi      \n\
+            subl    $1, %%ecx       \n\
+            jnz     3b              \n\
+            sfence                  \n\
+            movl    %%edx, %%ecx    \n\
+            cld                     \n\
+            rep     stosb           \n\
+            "
+            : "+D"(s), "+c"(n)
+            : "a"(c << 24 | c << 16 | c << 8 | c)
+            : "edx", "memory", "cc"
+            );
+}
+
+/* Which function to time */
+typedef enum {
+    BENCH_MEMCPY,
+    BENCH_OLD_MEMCPY,
+    BENCH_MEMMOVE,
+    BENCH_OLD_MEMMOVE,
+    BENCH_MEMSET,
+    BENCH_OLD_MEMSET,
+    BENCH_NT_MEMSET,
+} bench_func_t;
+
+/* Runs one of the functions on n bytes */
+static void
+bench_call(bench_func_t func, uint32_t n)
+{
+    /* memmove is timed on the backward (overlapping, dest > src) case */
+    switch (func) {
+    case BENCH_MEMCPY:
+        memcpy(bench_dest, bench_src, n);
+        break;
+    case BENCH_OLD_MEMCPY:
+        old_memcpy(bench_dest, bench_src, n);
+        break;
+    case BENCH_MEMMOVE:
+        memmove(bench_dest + 4, bench_dest, n);
+        break;
+    case BENCH_OLD_MEMMOVE:
+        old_memmove(bench_dest + 4, bench_dest, n);
+        break;
+    case BENCH_MEMSET:
+        memset(bench_dest, 0, n);
+        break;
+    case BENCH_OLD_MEMSET:
+        old_memset(bench_dest, 0, n);
+        break;
+    case BENCH_NT_MEMSET:
+        nt_memset(bench_dest, 0, n);
+        break;
+    }
+}
+
+/*
+ * Returns the best time of BENCH_RUNS runs of the function on n
+ * bytes. If cold is true, the destination is flushed out of the
+ * cache before each run.
+ */
+static uint32_t
+bench_time(bench_func_t func, uint32_t n, bool cold)
+{
+    uint32_t best = 0xFFFFFFFF;
+    int32_t i;
+
+    /* Warm up (and fault in the buffers) */
+    bench_call(func, n);
+
+    for (i = 0; i < BENCH_RUNS; ++i) {
+        if (cold) {
+            flush_cache(bench_dest, n + CACHE_LINE_SIZE);
+        }
+
+        uint64_t start = rdtsc();
+        bench_call(func, n);
+        uint64_t end = rdtsc();
+
+        if (end - start < best) {
+            best = end - start;
+        }
+    }
+    return best;
+}
+
+/*
+ * Prints a number right-aligned in a field of the given width,
+ * or left-aligned if width is negative. Sizes of 1K and up get
+ * a K or M suffix instead. Other numbers can be put in parens.
+ */
+static void
+print_num(uint32_t value, int32_t width, bool size, bool parens)
+{
+    int8_t buf[16];
+    int32_t len;
+
+    if (size && value >= 0x100000) {
+        itoa(value >> 20, buf, 10);
+        strcpy(buf + strlen(buf), "M");
+    } else if (size && value >= 0x400) {
+        itoa(value >> 10, buf, 10);
+        strcpy(buf + strlen(buf), "K");
+    } else {
+        itoa(value, buf, 10);
+    }
+
+    len = strlen(buf) + (parens ? 2 : 0);
+    if (width < 0) {
+        printf(parens ? "(%s)" : "%s", buf);
+        for (; len < -width; ++len) {
+            putc(' ');
+        }
+    } else {
+        for (; len < width; ++len) {
+            putc(' ');
+        }
+        printf(parens ? "(%s)" : "%s", buf);
+    }
+}
+
+/* Runs the benchmark and prints the table */
+static void
+membench(void)
+{
+    int32_t i;
+    printf("bytes    memcpy    (old)   memmove      (old)"
+           "    memset    (old)     (nt)   cold memset    (old)     (nt)\n");
+
+    for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); ++i) {
+        uint32_t n = bench_sizes[i];
+        print_num(n, -5, true, false);
+        print_num(bench_time(BENCH_MEMCPY, n, false), 10, false, false);
+        print_num(bench_time(BENCH_OLD_MEMCPY, n, false), 9, false, true);
+        print_num(bench_time(BENCH_MEMMOVE, n, false), 10, false, false);
+        print_num(bench_time(BENCH_OLD_MEMMOVE, n, false), 11, false, true);
+        print_num(bench_time(BENCH_MEMSET, n, false), 10, false, false);
+        print_num(bench_time(BENCH_OLD_MEMSET, n, false), 9, false, true);
+        print_num(bench_time(BENCH_NT_MEMSET, n, false), 9, false, true);
+        print_num(bench_time(BENCH_MEMSET, n, true), 14, false, false);
+        print_num(bench_time(BENCH_OLD_MEMSET, n, true), 9, false, true);
+        print_num(bench_time(BENCH_NT_MEMSET, n, true), 9, false, true);
+        putc('\n');
+    }
+
+    out_flush();
+}
+
+/* Entry point, called from _start below */
+__attribute__((used)) static void
+membench_main(void)
+{
+    membench();
+    linux_syscall(LINUX_SYS_EXIT, 0, 0, 0);
+}
+
+asm(".text                     \n\
+    .globl _start              \n\
+    _start:                    \n\
+    andl    $-16, %esp         \n\
+    call    membench_main      \n\
+    ");
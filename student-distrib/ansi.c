@@ -0,0 +1,125 @@
+#include "ansi.h"
+#include "lib.h"
+#include "debug.h"
+
+/* Starts a new sequence */
+static void
+ansi_reset_cmd(ansi_cmd_t *cmd)
+{
+    cmd->final = '\0';
+    cmd->csi = false;
+    cmd->private = false;
+    cmd->params[0] = -1;
+    cmd->num_params = 1;
+}
+
+/* Handles a character inside a control sequence */
+static bool
+ansi_parse_csi(ansi_parser_t *parser, uint8_t c, ansi_cmd_t **cmd)
+{
+    ansi_cmd_t *curr = &parser->cmd;
+
+    if (c < ' ') {
+        /*
+         * Control characters are executed as usual without
+         * terminating the sequence, as on a real VT100.
+         */
+        return false;
+    } else if (c >= '0' && c <= '9') {
+        int32_t *param = &curr->params[curr->num_params - 1];
+        if (*param < 0) {
+            *param = 0;
+        }
+        *param = *param * 10 + (c - '0');
+        if (*param > ANSI_MAX_PARAM_VALUE) {
+            *param = ANSI_MAX_PARAM_VALUE;
+        }
+    } else if (c == ';') {
+        /* If we're out of room, extra parameters replace the last one */
+        if (curr->num_params < ANSI_MAX_PARAMS) {
+            curr->params[curr->num_params++] = -1;
+        } else {
+            curr->params[curr->num_params - 1] = -1;
+        }
+    } else if (c == '?') {
+        curr->private = true;
+    } else if (c >= 0x40 && c <= 0x7e) {
+        /* Final character, we have a complete command */
+        curr->final = c;
+        curr->csi = true;
+        parser->state = ANSI_STATE_NORMAL;
+        *cmd = curr;
+    }
+
+    /* Anything else (intermediate characters) is ignored */
+    return true;
+}
+
+/*
+ * Feeds a character to the escape sequence parser. Returns
+ * false if the character is not part of an escape sequence
+ * and should be handled normally. Otherwise, returns true,
+ * and if the character completed a sequence, sets cmd to
+ * point to it (it is only valid until the next call). If
+ * no sequence was completed, cmd is set to NULL.
+ */
+bool
+ansi_parse(ansi_parser_t *parser, uint8_t c, ansi_cmd_t **cmd)
+{
+    *cmd = NULL;
+
+    /* ESC always starts a new sequence */
+    if (c == ANSI_ESC) {
+        ansi_reset_cmd(&parser->cmd);
+        parser->state = ANSI_STATE_ESC;
+        return true;
+    }
+
+    switch (parser->state) {
+    case ANSI_STATE_NORMAL:
+        return false;
+    case ANSI_STATE_ESC:
+        if (c == ANSI_CSI) {
+            parser->state = ANSI_STATE_CSI;
+        } else if (c >= 0x20 && c <= 0x2f) {
+            parser->state = ANSI_STATE_INTER;
+        } else {
+            parser->cmd.final = c;
+            parser->state = ANSI_STATE_NORMAL;
+            *cmd = &parser->cmd;
+        }
+        return true;
+    case ANSI_STATE_INTER:
+        /*
+         * Sequences with intermediates (character set selection
+         * like ESC ( B, or ESC # 8) aren't supported, so we just
+         * swallow them up to and including the final character.
+         */
+        if (c < ' ') {
+            return false;
+        } else if (c >= 0x30 && c <= 0x7e) {
+            parser->state = ANSI_STATE_NORMAL;
+        }
+        return true;
+    case ANSI_STATE_CSI:
+        return ansi_parse_csi(parser, c, cmd);
+    default:
+        ASSERT(0);
+        return false;
+    }
+}
+
+/*
+ * Returns the parameter at the specified index of a control
+ * sequence, or def if it was omitted or zero. (A zero parameter
+ * means "default" for all the commands we support that take
+ * counts or positions.)
+ */
+int32_t
+ansi_param(const ansi_cmd_t *cmd, int32_t index, int32_t def)
+{
+    if (index >= cmd->num_params || cmd->params[index] <= 0) {
+        return def;
+    }
+    return cmd->params[index];
+}
@@ -0,0 +1,67 @@
+#ifndef _ANSI_H
+#define _ANSI_H
+
+#include "types.h"
+
+/* Escape and control sequence introducer characters */
+#define ANSI_ESC '\033'
+#define ANSI_CSI '['
+
+/* DEC private mode that shows (ESC [ ? 25 h) or hides the cursor */
+#define ANSI_MODE_CURSOR 25
+
+/* Maximum number of parameters in a control sequence */
+#define ANSI_MAX_PARAMS 8
+
+/* Parameter values are clamped to this */
+#define ANSI_MAX_PARAM_VALUE 9999
+
+#ifndef ASM
+
+/* Parser state */
+typedef enum {
+    ANSI_STATE_NORMAL, /* Not in an escape sequence */
+    ANSI_STATE_ESC,    /* Seen ESC */
+    ANSI_STATE_INTER,  /* Seen ESC and an intermediate, like ESC ( */
+    ANSI_STATE_CSI,    /* Seen ESC [ */
+} ansi_state_t;
+
+/* A complete escape sequence */
+typedef struct {
+    /*
+     * The final character of the sequence. For control sequences
+     * (ESC [ ...), this is the command letter; for other escape
+     * sequences, this is the character following ESC and csi
+     * is false.
+     */
+    uint8_t final;
+
+    /* Whether this is a control sequence */
+    bool csi;
+
+    /* Whether the parameters started with '?' (DEC private mode) */
+    bool private;
+
+    /*
+     * Numeric parameters. Omitted parameters are -1, so that the
+     * command can substitute its own default.
+     */
+    int32_t params[ANSI_MAX_PARAMS];
+    int32_t num_params;
+} ansi_cmd_t;
+
+/* Escape sequence parser */
+typedef struct {
+    ansi_state_t state;
+    ansi_cmd_t cmd;
+} ansi_parser_t;
+
+/* Feeds a character to the parser */
+bool ansi_parse(ansi_parser_t *parser, uint8_t c, ansi_cmd_t **cmd);
+
+/* Returns the specified parameter, or def if it was omitted */
+int32_t ansi_param(const ansi_cmd_t *cmd, int32_t index, int32_t def);
+
+#endif /* ASM */
+
+#endif /* _ANSI_H */
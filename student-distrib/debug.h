@@ -4,12 +4,16 @@
 #ifndef ASM
 
 #include "lib.h"
+#include "klog.h"
 
 /* Whether to enable assertions */
 #define DEBUG_ASSERT 1
 
-/* Whether to enable debugf printing */
-#define DEBUG_PRINT 0
+/*
+ * Whether to enable debugf logging. This only writes to the
+ * kernel log (see klog.c), so it's cheap enough to leave on.
+ */
+#define DEBUG_PRINT 1
 
 #if DEBUG_ASSERT
 
@@ -30,11 +34,8 @@ do {                           \
 
 #if DEBUG_PRINT
 
-#define debugf(...)            \
-do {                           \
-    printf(__FILE__ ":%u: ", __LINE__);    \
-    printf(__VA_ARGS__);       \
-} while(0)
+#define debugf(fmt, ...)       \
+    klog(KLOG_DEBUG, __FILE__ ":%u: " fmt, __LINE__, ##__VA_ARGS__)
 
 #else /* DEBUG_PRINT */
 
@@ -5,6 +5,8 @@
 #include "filesys.h"
 #include "terminal.h"
 #include "process.h"
+#include "klog.h"
+#include "irqfd.h"
 
 /* Terminal stdin file ops */
 static file_ops_t fops_stdin = {
@@ -54,6 +56,32 @@ static file_ops_t fops_mouse = {
     .close = terminal_mouse_close
 };
 
+/* Kernel log file ops (read by the dmesg program) */
+static file_ops_t fops_klog = {
+    .open = klog_open,
+    .read = klog_read,
+    .write = klog_write,
+    .close = klog_close
+};
+
+/* IRQ forwarding file ops */
+static file_ops_t fops_irq = {
+    .open = irqfd_open,
+    .read = irqfd_read,
+    .write = irqfd_write,
+    .close = irqfd_close
+};
+
+/*
+ * Devices that don't have an entry in the filesystem image.
+ * These are looked up by name if the filesystem doesn't have
+ * a file with the requested name.
+ */
+static device_t devices[] = {
+    {"klog", &fops_klog},
+    {IRQFD_NAME, &fops_irq},
+};
+
 /* Initializes the file object from the given dentry */
 static bool
 init_file_obj(file_obj_t *file, dentry_t *dentry)
@@ -83,6 +111,27 @@ init_file_obj(file_obj_t *file, dentry_t *dentry)
     return true;
 }
 
+/*
+ * Initializes the file object for the device with the specified
+ * name. Returns false if there is no such device.
+ */
+static bool
+init_device_obj(file_obj_t *file, const uint8_t *filename)
+{
+    int32_t i;
+    for (i = 0; i < sizeof(devices) / sizeof(devices[0]); ++i) {
+        if (strcmp((const int8_t *)filename, devices[i].name) == 0) {
+            file->inode_idx = 0;
+            file->offset = 0;
+            file->ops_table = devices[i].ops_table;
+            file->valid = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /* Gets the file object array for the executing process */
 static file_obj_t *
 get_executing_file_objs(void)
@@ -144,13 +193,12 @@ file_open(const uint8_t *filename)
     /* Skip fd = 0 (stdin) and fd = 1 (stdout) */
     for (i = 2; i < MAX_FILES; ++i) {
         if (!files[i].valid) {
-            /* Try to read filesystem entry */
-            if (read_dentry_by_name(filename, &dentry) != 0) {
-                return -1;
-            }
-
-            /* Initialize file object */
-            if (!init_file_obj(&files[i], &dentry)) {
+            /* Try to read filesystem entry, then fall back to devices */
+            if (read_dentry_by_name(filename, &dentry) == 0) {
+                if (!init_file_obj(&files[i], &dentry)) {
+                    return -1;
+                }
+            } else if (!init_device_obj(&files[i], filename)) {
                 return -1;
             }
 
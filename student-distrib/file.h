@@ -28,7 +28,8 @@ typedef struct {
      * *offset in bytes* of the current file position.
      * For the RTC, this holds the virtual interrupt
      * frequency. For the mouse, this holds the index
-     * of the corresponding input buffer.
+     * of the corresponding input buffer. For the IRQ
+     * device, this holds the forwarded IRQ number.
      */
     uint32_t offset;
 
@@ -46,6 +47,12 @@ struct file_ops_t {
     int32_t (*close)(file_obj_t *file);
 };
 
+/* Built-in device that can be opened by name */
+typedef struct {
+    const int8_t *name;
+    file_ops_t *ops_table;
+} device_t;
+
 /* Initializes the specified file object array */
 void file_init(file_obj_t *files);
 
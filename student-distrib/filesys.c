@@ -17,19 +17,28 @@ static boot_block_t *fs_boot_block = NULL;
 static int32_t
 fs_cmp_name(const uint8_t *search_name, const uint8_t *file_name)
 {
-    int32_t i;
-    for (i = 0; i < FS_MAX_FNAME_LEN; i++) {
-        if (search_name[i] != file_name[i] || file_name[i] == '\0') {
-            return search_name[i] - file_name[i];
-        }
+    int32_t cmp = strncmp((const int8_t *)search_name,
+                          (const int8_t *)file_name, FS_MAX_FNAME_LEN);
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    /*
+     * The names matched up to the first \0 or 32 chars. If the
+     * file name has a \0 in it, so did the search name, and it
+     * has ended (there may be junk after the \0 in the dentry,
+     * so we can't just look at its last byte).
+     */
+    if (memchr(file_name, '\0', FS_MAX_FNAME_LEN) != NULL) {
+        return 0;
     }
 
     /*
-     * We checked all 32 chars, now check if the search filename
+     * All 32 chars matched, now check if the search filename
      * is also 32 chars long (meaning a \0 at the 33rd byte),
      * otherwise the filenames don't actually match.
      */
-    return search_name[i] - '\0';
+    return search_name[FS_MAX_FNAME_LEN] - '\0';
 }
 
 /*
@@ -14,6 +14,9 @@ do {                                        \
     SET_IDT_ENTRY(idt[i], name);            \
 } while (0)
 
+/* Whether the IRQ being handled interrupted userspace */
+static bool irq_from_user = false;
+
 /* Exception number to name table */
 static const char *exception_names[] = {
     "Divide error exception",
@@ -106,7 +109,20 @@ static void
 handle_irq(int_regs_t *regs)
 {
     uint32_t irq_num = regs->int_num - INT_IRQ0;
+    irq_from_user = (regs->cs == USER_CS);
     irq_handle_interrupt(irq_num);
+    irq_from_user = false;
+}
+
+/*
+ * Returns whether the IRQ being handled interrupted userspace.
+ * Since the kernel only enables interrupts while it is waiting,
+ * an IRQ that didn't come from userspace found the CPU idle.
+ */
+bool
+idt_irq_from_user(void)
+{
+    return irq_from_user;
 }
 
 /* Syscall handler */
@@ -137,12 +153,16 @@ idt_handle_interrupt(int_regs_t *regs)
     }
 
     /*
+     * On the way back to userspace we're in process context again,
+     * so this is where shells for newly used terminals get loaded.
+     *
      * If process has any pending signals, run their handlers.
      * Note that since we have security checks inside sigreturn,
      * we only do this if we came from userspace, since that's
      * the only place we can safely return to after sigreturn.
      */
     if (regs->cs == USER_CS) {
+        process_start_pending_shells();
         signal_handle_all(regs);
     }
 }
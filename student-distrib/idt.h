@@ -88,6 +88,9 @@ void idt_init(void);
 /* Interrupt handler routine */
 void idt_handle_interrupt(int_regs_t *regs);
 
+/* Whether the IRQ being handled interrupted userspace */
+bool idt_irq_from_user(void);
+
 #endif /* ASM */
 
 #endif /* _IDT_H */
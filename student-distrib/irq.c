@@ -18,6 +18,8 @@ irq_handle_interrupt(uint32_t irq_num)
     /* Run callback if it's registered */
     if (handler.callback != NULL) {
         handler.callback();
+    } else if (handler.line_callback != NULL) {
+        handler.line_callback(irq_num);
     }
 }
 
@@ -34,6 +36,21 @@ irq_register_handler(uint32_t irq_num, void (*callback)(void))
 {
     ASSERT(irq_num < NUM_IRQ);
     irq_handlers[irq_num].callback = callback;
+    irq_handlers[irq_num].line_callback = NULL;
+    i8259_enable_irq(irq_num);
+}
+
+/*
+ * Registers an IRQ handler that is passed the number of the
+ * line that fired, so one callback can serve several lines.
+ * The same rules as irq_register_handler apply.
+ */
+void
+irq_register_line_handler(uint32_t irq_num, void (*callback)(uint32_t irq_num))
+{
+    ASSERT(irq_num < NUM_IRQ);
+    irq_handlers[irq_num].callback = NULL;
+    irq_handlers[irq_num].line_callback = callback;
     i8259_enable_irq(irq_num);
 }
 
@@ -49,4 +66,14 @@ irq_unregister_handler(uint32_t irq_num)
     ASSERT(irq_num < NUM_IRQ);
     i8259_disable_irq(irq_num);
     irq_handlers[irq_num].callback = NULL;
+    irq_handlers[irq_num].line_callback = NULL;
+}
+
+/* Returns whether a handler is registered for the IRQ line */
+bool
+irq_is_registered(uint32_t irq_num)
+{
+    ASSERT(irq_num < NUM_IRQ);
+    return irq_handlers[irq_num].callback != NULL ||
+           irq_handlers[irq_num].line_callback != NULL;
 }
@@ -9,6 +9,7 @@
 /* IRQ number constants */
 #define IRQ_PIT      0
 #define IRQ_KEYBOARD 1
+#define IRQ_SERIAL   4
 #define IRQ_RTC      8
 #define IRQ_MOUSE    12
 
@@ -19,6 +20,9 @@ typedef struct irq_handler_t
 {
     /* Callback to run when the interrupt occurs */
     void (*callback)(void);
+
+    /* Same, for callbacks that serve several lines */
+    void (*line_callback)(uint32_t irq_num);
 } irq_handler_t;
 
 /* IRQ interrupt handler */
@@ -27,9 +31,15 @@ void irq_handle_interrupt(uint32_t irq_num);
 /* Registers an IRQ handler */
 void irq_register_handler(uint32_t irq_num, void (*callback)(void));
 
+/* Registers an IRQ handler that is passed the IRQ number */
+void irq_register_line_handler(uint32_t irq_num, void (*callback)(uint32_t irq_num));
+
 /* Unregisters an IRQ handler */
 void irq_unregister_handler(uint32_t irq_num);
 
+/* Returns whether the IRQ line has a handler */
+bool irq_is_registered(uint32_t irq_num);
+
 #endif /* ASM */
 
 #endif /* _IRQ_H */
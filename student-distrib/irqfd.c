@@ -0,0 +1,117 @@
+#include "irqfd.h"
+#include "lib.h"
+#include "debug.h"
+#include "irq.h"
+#include "i8259.h"
+#include "signal.h"
+#include "process.h"
+
+/*
+ * Forwards interrupts on an IRQ line to a user-space driver.
+ * The driver opens the device, writes the IRQ number to claim
+ * the line, and then reads to wait for interrupts. The line
+ * is masked when an interrupt comes in, and unmasked by the
+ * next read, so a driver must service its device before it
+ * reads again (otherwise a level-triggered device will just
+ * interrupt again straight away).
+ */
+
+/* File offset before the file has claimed a line */
+#define IRQFD_UNBOUND NUM_IRQ
+
+/* Number of interrupts on each forwarded line not yet read */
+static volatile uint32_t irqfd_counts[NUM_IRQ];
+
+/* IRQ handler callback for forwarded lines */
+static void
+irqfd_handle_irq(uint32_t irq_num)
+{
+    /* Keep the line quiet until the driver has dealt with it */
+    i8259_disable_irq(irq_num);
+    irqfd_counts[irq_num]++;
+}
+
+/*
+ * Open syscall for the IRQ device. The file doesn't forward
+ * anything until a line is written to it.
+ */
+int32_t
+irqfd_open(const uint8_t *filename, file_obj_t *file)
+{
+    file->offset = IRQFD_UNBOUND;
+    return 0;
+}
+
+/*
+ * Read syscall for the IRQ device. Unmasks the line if there
+ * is no interrupt waiting, then waits for one. Writes the
+ * number of interrupts since the last read as a uint32_t and
+ * returns 4, or returns -1 if a signal came in first.
+ */
+int32_t
+irqfd_read(file_obj_t *file, void *buf, int32_t nbytes)
+{
+    uint32_t irq_num = file->offset;
+    if (irq_num == IRQFD_UNBOUND || nbytes < (int32_t)sizeof(uint32_t)) {
+        return -1;
+    }
+    if (!is_user_writable(buf, sizeof(uint32_t))) {
+        return -1;
+    }
+
+    if (irqfd_counts[irq_num] == 0) {
+        i8259_enable_irq(irq_num);
+    }
+
+    while (irqfd_counts[irq_num] == 0) {
+        /* Exit early if we have a pending signal */
+        if (signal_has_pending()) {
+            return -1;
+        }
+
+        /* Sleep and wait for a new interrupt */
+        process_idle();
+    }
+
+    *(uint32_t *)buf = irqfd_counts[irq_num];
+    irqfd_counts[irq_num] = 0;
+    return sizeof(uint32_t);
+}
+
+/*
+ * Write syscall for the IRQ device. Claims the IRQ line given
+ * by the int32_t in buf. Fails if the file already has a line,
+ * or the line is the cascade or already has a handler (in the
+ * kernel or in another process).
+ */
+int32_t
+irqfd_write(file_obj_t *file, const void *buf, int32_t nbytes)
+{
+    int32_t irq_num;
+    if (nbytes != sizeof(int32_t) || file->offset != IRQFD_UNBOUND) {
+        return -1;
+    }
+    if (!copy_from_user(&irq_num, buf, sizeof(int32_t))) {
+        return -1;
+    }
+    if (irq_num < 0 || irq_num >= NUM_IRQ || irq_num == IRQ_SLAVE ||
+        irq_is_registered(irq_num)) {
+        return -1;
+    }
+
+    irqfd_counts[irq_num] = 0;
+    file->offset = irq_num;
+    irq_register_line_handler(irq_num, irqfd_handle_irq);
+    return 0;
+}
+
+/* Close syscall for the IRQ device. Gives the line back. */
+int32_t
+irqfd_close(file_obj_t *file)
+{
+    if (file->offset != IRQFD_UNBOUND) {
+        irq_unregister_handler(file->offset);
+        irqfd_counts[file->offset] = 0;
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _IRQFD_H
+#define _IRQFD_H
+
+#include "types.h"
+#include "file.h"
+
+/* Name of the IRQ forwarding device */
+#define IRQFD_NAME "irq"
+
+#ifndef ASM
+
+/* IRQ forwarding device syscall handlers */
+int32_t irqfd_open(const uint8_t *filename, file_obj_t *file);
+int32_t irqfd_read(file_obj_t *file, void *buf, int32_t nbytes);
+int32_t irqfd_write(file_obj_t *file, const void *buf, int32_t nbytes);
+int32_t irqfd_close(file_obj_t *file);
+
+#endif /* ASM */
+
+#endif /* _IRQFD_H */
@@ -10,14 +10,119 @@
 #include "ps2.h"
 #include "keyboard.h"
 #include "rtc.h"
+#include "serial.h"
+#include "vbe.h"
+#include "klog.h"
 #include "terminal.h"
 #include "filesys.h"
 #include "file.h"
+#include "shlib.h"
 
 /* Macros. */
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags,bit)   ((flags) & (1 << (bit)))
 
+/*
+ * Finds a "name=value" option in the kernel command line.
+ * Returns a pointer to the value (which ends at the next
+ * space or the end of the string), or NULL if the option
+ * isn't there.
+ */
+static const int8_t *
+get_boot_option(const int8_t *cmdline, const int8_t *name)
+{
+    uint32_t len = strlen(name);
+    while (*cmdline != '\0') {
+        if (strncmp(cmdline, name, len) == 0 && cmdline[len] == '=') {
+            return &cmdline[len + 1];
+        }
+
+        /* Skip to the start of the next option */
+        while (*cmdline != '\0' && *cmdline != ' ') {
+            cmdline++;
+        }
+        while (*cmdline == ' ') {
+            cmdline++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Parses the numeric value of a "name=value" boot option into
+ * out_result. Returns false if the option is missing or isn't
+ * a number.
+ */
+static bool
+get_boot_number(const int8_t *cmdline, const int8_t *name, int32_t *out_result)
+{
+    const int8_t *value = get_boot_option(cmdline, name);
+    if (value == NULL) {
+        return false;
+    }
+
+    /* Copy the value out so it's NUL-terminated */
+    int8_t buf[12];
+    uint32_t len = 0;
+    while (value[len] != '\0' && value[len] != ' ' && len < sizeof(buf) - 1) {
+        buf[len] = value[len];
+        len++;
+    }
+    buf[len] = '\0';
+
+    return atoi_s(buf, out_result) != NULL;
+}
+
+/*
+ * Parses the "terminals" boot option, which sets the number
+ * of terminals (one for each of Alt+F1 to Alt+F12).
+ */
+static int32_t
+parse_terminals_option(const int8_t *cmdline)
+{
+    int32_t count = DEFAULT_TERMINALS;
+    if (get_boot_option(cmdline, "terminals") != NULL &&
+        (!get_boot_number(cmdline, "terminals", &count) ||
+         count < 1 || count > MAX_TERMINALS)) {
+        klog(KLOG_WARN, "Ignoring invalid terminals option\n");
+        count = DEFAULT_TERMINALS;
+    }
+
+    /* Each terminal needs a process for its shell */
+    if (count > process_get_max() && process_get_max() >= 1) {
+        klog(KLOG_WARN, "Only enough memory for %d terminals\n", process_get_max());
+        count = process_get_max();
+    }
+
+    return count;
+}
+
+/*
+ * Parses the "serial" boot option, which selects what goes to
+ * the serial port: "serial=kernel" for kernel output, or
+ * "serial=N" to bind terminal N (starting from 1). This must
+ * be parsed after the number of terminals has been set.
+ */
+static int32_t
+parse_serial_option(const int8_t *cmdline)
+{
+    const int8_t *value = get_boot_option(cmdline, "serial");
+    int32_t index;
+    if (value == NULL) {
+        return TERMINAL_SERIAL_NONE;
+    }
+
+    if (strncmp(value, "kernel", 6) == 0) {
+        return TERMINAL_SERIAL_KERNEL;
+    } else if (get_boot_number(cmdline, "serial", &index) &&
+               index >= 1 && index <= get_num_terminals()) {
+        return index - 1;
+    }
+
+    klog(KLOG_WARN, "Ignoring invalid serial option\n");
+    return TERMINAL_SERIAL_NONE;
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void
@@ -28,6 +133,9 @@ entry (unsigned long magic, unsigned long addr)
     /* Starting address of the filesystem module */
     uint32_t fs_start = 0;
 
+    /* What to bind to the serial port */
+    int32_t serial_binding = TERMINAL_SERIAL_NONE;
+
     /* Initialize terminals */
     terminal_init();
 
@@ -37,7 +145,7 @@ entry (unsigned long magic, unsigned long addr)
     /* Am I booted by a Multiboot-compliant boot loader? */
     if (magic != MULTIBOOT_BOOTLOADER_MAGIC)
     {
-        printf ("Invalid magic number: 0x%#x\n", (unsigned) magic);
+        klog(KLOG_ERR, "Invalid magic number: 0x%#x\n", (unsigned) magic);
         return;
     }
 
@@ -45,20 +153,30 @@ entry (unsigned long magic, unsigned long addr)
     mbi = (multiboot_info_t *) addr;
 
     /* Print out the flags. */
-    printf ("flags = 0x%#x\n", (unsigned) mbi->flags);
+    klog(KLOG_INFO, "flags = 0x%#x\n", (unsigned) mbi->flags);
 
     /* Are mem_* valid? */
-    if (CHECK_FLAG (mbi->flags, 0))
-        printf ("mem_lower = %uKB, mem_upper = %uKB\n",
+    if (CHECK_FLAG (mbi->flags, 0)) {
+        klog(KLOG_INFO, "mem_lower = %uKB, mem_upper = %uKB\n",
                 (unsigned) mbi->mem_lower, (unsigned) mbi->mem_upper);
 
+        /* Don't hand out process pages past the end of memory */
+        process_set_memory(mbi->mem_upper);
+        if (process_get_max() < MAX_PROCESSES) {
+            klog(KLOG_WARN, "Only enough memory for %d processes\n", process_get_max());
+        }
+    }
+
     /* Is boot_device valid? */
     if (CHECK_FLAG (mbi->flags, 1))
-        printf ("boot_device = 0x%#x\n", (unsigned) mbi->boot_device);
+        klog(KLOG_INFO, "boot_device = 0x%#x\n", (unsigned) mbi->boot_device);
 
     /* Is the command line passed? */
-    if (CHECK_FLAG (mbi->flags, 2))
-        printf ("cmdline = %s\n", (char *) mbi->cmdline);
+    if (CHECK_FLAG (mbi->flags, 2)) {
+        klog(KLOG_INFO, "cmdline = %s\n", (char *) mbi->cmdline);
+        terminal_set_count(parse_terminals_option((int8_t *)mbi->cmdline));
+        serial_binding = parse_serial_option((int8_t *)mbi->cmdline);
+    }
 
     if (CHECK_FLAG (mbi->flags, 3)) {
         int mod_count = 0;
@@ -73,13 +191,15 @@ entry (unsigned long magic, unsigned long addr)
         fs_start = mod->mod_start;
 
         while (mod_count < mbi->mods_count) {
-            printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
-            printf("Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
-            printf("First few bytes of module:\n");
+            klog(KLOG_INFO, "Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
+            klog(KLOG_INFO, "Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
+            char bytes[16 * 5 + 1];
+            int len = 0;
             for (i = 0; i < 16; i++) {
-                printf("0x%x ", *((uint8_t *)(mod->mod_start + i)));
+                len += snprintf(&bytes[len], sizeof(bytes) - len, "0x%x ",
+                                *((uint8_t *)(mod->mod_start + i)));
             }
-            printf("\n");
+            klog(KLOG_INFO, "First few bytes of module: %s\n", bytes);
             mod_count++;
             mod++;
         }
@@ -88,7 +208,7 @@ entry (unsigned long magic, unsigned long addr)
     /* Bits 4 and 5 are mutually exclusive! */
     if (CHECK_FLAG (mbi->flags, 4) && CHECK_FLAG (mbi->flags, 5))
     {
-        printf ("Both bits 4 and 5 are set.\n");
+        klog(KLOG_ERR, "Both bits 4 and 5 are set.\n");
         return;
     }
 
@@ -97,7 +217,7 @@ entry (unsigned long magic, unsigned long addr)
     {
         elf_section_header_table_t *elf_sec = &(mbi->elf_sec);
 
-        printf ("elf_sec: num = %u, size = 0x%#x,"
+        klog(KLOG_INFO, "elf_sec: num = %u, size = 0x%#x,"
                 " addr = 0x%#x, shndx = 0x%#x\n",
                 (unsigned) elf_sec->num, (unsigned) elf_sec->size,
                 (unsigned) elf_sec->addr, (unsigned) elf_sec->shndx);
@@ -108,13 +228,13 @@ entry (unsigned long magic, unsigned long addr)
     {
         memory_map_t *mmap;
 
-        printf ("mmap_addr = 0x%#x, mmap_length = 0x%x\n",
+        klog(KLOG_INFO, "mmap_addr = 0x%#x, mmap_length = 0x%x\n",
                 (unsigned) mbi->mmap_addr, (unsigned) mbi->mmap_length);
         for (mmap = (memory_map_t *) mbi->mmap_addr;
                 (unsigned long) mmap < mbi->mmap_addr + mbi->mmap_length;
                 mmap = (memory_map_t *) ((unsigned long) mmap
                     + mmap->size + sizeof (mmap->size)))
-            printf (" size = 0x%x,     base_addr = 0x%#x%#x\n"
+            klog(KLOG_INFO, " size = 0x%x,     base_addr = 0x%#x%#x\n"
                     "     type = 0x%x,  length    = 0x%#x%#x\n",
                     (unsigned) mmap->size,
                     (unsigned) mmap->base_addr_high,
@@ -162,35 +282,51 @@ entry (unsigned long magic, unsigned long addr)
         tss.ldt_segment_selector = KERNEL_LDT;
         tss.ss0 = KERNEL_DS;
         tss.esp0 = 0x800000;
+        tss.io_base_addr = TSS_SIZE;
+        memset(tss.io_bitmap, 0xFF, IO_BITMAP_SIZE);
+        tss.io_bitmap_end = 0xFF;
         ltr(KERNEL_TSS);
     }
 
-    printf("Initializing IDT...\n");
+    klog(KLOG_INFO, "Initializing IDT...\n");
     idt_init();
 
-    printf("Initializing PIC...\n");
+    klog(KLOG_INFO, "Initializing PIC...\n");
     i8259_init();
 
-    printf("Initializing PIT...\n");
+    klog(KLOG_INFO, "Initializing PIT...\n");
     pit_init();
 
-    printf("Initializing PS/2 devices...\n");
+    klog(KLOG_INFO, "Initializing serial port...\n");
+    serial_init();
+    if (serial_present()) {
+        terminal_bind_serial(serial_binding);
+        klog_set_serial(serial_binding == TERMINAL_SERIAL_KERNEL);
+    }
+
+    klog(KLOG_INFO, "Initializing PS/2 devices...\n");
     ps2_init();
 
-    printf("Initializing RTC...\n");
+    klog(KLOG_INFO, "Initializing RTC...\n");
     rtc_init();
 
-    printf("Enabling paging...\n");
+    klog(KLOG_INFO, "Enabling paging...\n");
     paging_enable();
 
-    printf("Initializing filesystem...\n");
+    klog(KLOG_INFO, "Initializing VBE graphics...\n");
+    vbe_init();
+
+    klog(KLOG_INFO, "Initializing filesystem...\n");
     fs_init(fs_start);
 
-    printf("Initializing processes...\n");
+    klog(KLOG_INFO, "Loading shared library...\n");
+    shlib_init();
+
+    klog(KLOG_INFO, "Initializing processes...\n");
     process_init();
 
     /* We made it! */
-    printf("Boot successful!\n");
+    klog(KLOG_INFO, "Boot successful!\n");
     clear();
 
     /* Execute the first program (`shell') ... */
@@ -129,13 +129,23 @@ keycode_to_ctrl(uint8_t keycode)
         }
         break;
     case KMOD_ALT:
+        /* ALT-F1 through ALT-F10 have consecutive keycodes */
+        if (keycode >= KC_F1 && keycode <= KC_F10) {
+            return KCTL_TERM1 + (keycode - KC_F1);
+        }
+        switch (keycode) {
+        case KC_F11: /* ALT-F11 */
+            return KCTL_TERM11;
+        case KC_F12: /* ALT-F12 */
+            return KCTL_TERM12;
+        }
+        break;
+    case KMOD_SHIFT:
         switch (keycode) {
-        case KC_F1: /* ALT-F1 */
-            return KCTL_TERM1;
-        case KC_F2: /* ALT-F2 */
-            return KCTL_TERM2;
-        case KC_F3: /* ALT-F3 */
-            return KCTL_TERM3;
+        case KC_PAGE_UP: /* SHIFT-PGUP */
+            return KCTL_SCROLL_UP;
+        case KC_PAGE_DOWN: /* SHIFT-PGDN */
+            return KCTL_SCROLL_DOWN;
         }
         break;
     }
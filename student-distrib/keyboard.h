@@ -17,6 +17,9 @@
 #define KC_F1        0x3B
 #define KC_F2        0x3C
 #define KC_F3        0x3D
+#define KC_F10       0x44
+#define KC_F11       0x57
+#define KC_F12       0x58
 #define KC_BACKSPACE 0x0E
 #define KC_DELETE    0x53
 #define KC_TAB       0x0F
@@ -25,6 +28,8 @@
 #define KC_3         0x04
 #define KC_4         0x05
 #define KC_5         0x06
+#define KC_PAGE_UP   0x49
+#define KC_PAGE_DOWN 0x51
 
 /* Number of keys we handle */
 #define NUM_KEYS 58
@@ -64,6 +69,17 @@ typedef enum {
     KCTL_TERM1,     /* Switch to terminal 1 */
     KCTL_TERM2,     /* Switch to terminal 2 */
     KCTL_TERM3,     /* Switch to terminal 3 */
+    KCTL_TERM4,     /* Switch to terminal 4 */
+    KCTL_TERM5,     /* Switch to terminal 5 */
+    KCTL_TERM6,     /* Switch to terminal 6 */
+    KCTL_TERM7,     /* Switch to terminal 7 */
+    KCTL_TERM8,     /* Switch to terminal 8 */
+    KCTL_TERM9,     /* Switch to terminal 9 */
+    KCTL_TERM10,    /* Switch to terminal 10 */
+    KCTL_TERM11,    /* Switch to terminal 11 */
+    KCTL_TERM12,    /* Switch to terminal 12 */
+    KCTL_SCROLL_UP,   /* Page back through the scrollback history */
+    KCTL_SCROLL_DOWN, /* Page forward through the scrollback history */
 } kbd_input_ctrl_t;
 
 /* Keyboard input struct */
@@ -0,0 +1,313 @@
+#include "klog.h"
+#include "lib.h"
+#include "debug.h"
+#include "pit.h"
+#include "serial.h"
+
+/* Messages at or above this severity are also printed to the screen */
+#define KLOG_CONSOLE_LEVEL KLOG_ERR
+
+/* Microseconds per PIT tick */
+#define USEC_PER_TICK (1000000 / PIT_FREQ_SCHEDULER)
+
+/* Maximum length of a formatted dmesg line */
+#define KLOG_LINE_SIZE (KLOG_MSG_SIZE + 32)
+
+/* Log ring */
+static klog_entry_t klog_ring[KLOG_NUM_ENTRIES];
+
+/* Sequence number of the next entry to be written */
+static volatile uint32_t klog_next = 0;
+
+/* Whether messages are also sent to the serial port */
+static bool klog_serial = false;
+
+/*
+ * TSC value at the first PIT tick, and the number of ticks
+ * since then. Together these let us turn TSC values into
+ * real time without a separate calibration step.
+ */
+static uint64_t klog_tsc_base = 0;
+static volatile uint32_t klog_ticks = 0;
+
+/* Reads the timestamp counter */
+static uint64_t
+klog_rdtsc(void)
+{
+    uint64_t tsc;
+    asm volatile("rdtsc" : "=A"(tsc));
+    return tsc;
+}
+
+/*
+ * Divides a 64-bit value by a 32-bit value. The quotient
+ * must fit in 32 bits. Writes the remainder to rem.
+ */
+static uint32_t
+klog_div64(uint64_t n, uint32_t d, uint32_t *rem)
+{
+    uint32_t hi = (uint32_t)(n >> 32) % d;
+    uint32_t lo = (uint32_t)n;
+    uint32_t q;
+    asm("divl %4"
+        : "=a"(q), "=d"(*rem)
+        : "a"(lo), "d"(hi), "rm"(d)
+        : "cc");
+    return q;
+}
+
+/*
+ * Atomically claims the next sequence number. This is what
+ * makes logging lock-free: a writer interrupted by another
+ * writer simply ends up with a different entry.
+ */
+static uint32_t
+klog_reserve(void)
+{
+    uint32_t seq = 1;
+    asm volatile("lock xaddl %0, %1"
+                 : "+r"(seq), "+m"(klog_next)
+                 :
+                 : "memory", "cc");
+    return seq;
+}
+
+/* Sends a message to the serial port, with a CR LF line ending */
+static void
+klog_write_serial(const int8_t *msg)
+{
+    static const uint8_t crlf[] = {'\r', '\n'};
+    int32_t len = strlen(msg);
+    if (len > 0 && msg[len - 1] == '\n') {
+        len--;
+    }
+    serial_write((const uint8_t *)msg, len);
+    serial_write(crlf, sizeof(crlf));
+}
+
+/*
+ * Adds a message to the kernel log. Supports the same formats
+ * as printf(); messages longer than KLOG_MSG_SIZE - 1 characters
+ * are truncated. The message is formatted straight into the log
+ * ring, so this is cheap enough to call from anywhere, including
+ * interrupt handlers.
+ */
+void
+klog(int32_t level, int8_t *format, ...)
+{
+    int32_t *esp = (void *)&format;
+    esp++;
+
+    uint32_t seq = klog_reserve();
+    klog_entry_t *entry = &klog_ring[seq & (KLOG_NUM_ENTRIES - 1)];
+
+    /* Invalidate the entry while we're writing it */
+    entry->seq = 0;
+    asm volatile("" : : : "memory");
+
+    entry->tsc = klog_rdtsc();
+    entry->level = level;
+    vsnprintf(entry->msg, KLOG_MSG_SIZE, format, esp);
+
+    /* Publish the entry */
+    asm volatile("" : : : "memory");
+    entry->seq = seq + 1;
+
+    /*
+     * Console output is already mirrored to the serial port when
+     * the kernel owns it, so only send the rest separately.
+     */
+    if (level <= KLOG_CONSOLE_LEVEL) {
+        puts(entry->msg);
+    } else if (klog_serial) {
+        klog_write_serial(entry->msg);
+    }
+}
+
+/* Sets whether log messages are also sent to the serial port */
+void
+klog_set_serial(bool enabled)
+{
+    klog_serial = enabled;
+}
+
+/*
+ * Updates the timestamp calibration. Must be called from
+ * the PIT interrupt handler.
+ */
+void
+klog_tick(void)
+{
+    if (klog_ticks == 0) {
+        klog_tsc_base = klog_rdtsc();
+    }
+    klog_ticks++;
+}
+
+/*
+ * Converts a TSC value to seconds and microseconds since
+ * the first PIT tick. Times before that (or before we have
+ * enough ticks to know the TSC frequency) come out as 0.
+ */
+static void
+klog_tsc_to_time(uint64_t tsc, uint32_t *sec, uint32_t *usec)
+{
+    *sec = 0;
+    *usec = 0;
+
+    uint32_t ticks = klog_ticks;
+    if (ticks < 2 || tsc < klog_tsc_base) {
+        return;
+    }
+
+    /* Work out the average number of TSC cycles per tick */
+    uint32_t rem;
+    uint32_t cycles_per_tick = klog_div64(klog_rdtsc() - klog_tsc_base, ticks - 1, &rem);
+    if (cycles_per_tick == 0) {
+        return;
+    }
+
+    /* Then convert the timestamp to whole ticks + microseconds */
+    uint32_t elapsed_ticks = klog_div64(tsc - klog_tsc_base, cycles_per_tick, &rem);
+    uint32_t frac = klog_div64((uint64_t)rem * USEC_PER_TICK, cycles_per_tick, &rem);
+    *sec = elapsed_ticks / PIT_FREQ_SCHEDULER;
+    *usec = (elapsed_ticks % PIT_FREQ_SCHEDULER) * USEC_PER_TICK + frac;
+}
+
+/*
+ * Writes a number into buf, padded on the left to the
+ * specified width with the specified character. Returns
+ * the number of characters written.
+ */
+static int32_t
+klog_format_num(int8_t *buf, uint32_t value, int32_t width, int8_t pad)
+{
+    int8_t digits[16];
+    itoa(value, digits, 10);
+    int32_t len = strlen(digits);
+    int32_t i = 0;
+    for (; i < width - len; ++i) {
+        buf[i] = pad;
+    }
+    strcpy(&buf[i], digits);
+    return i + len;
+}
+
+/*
+ * Formats a log entry as a dmesg line, like
+ * "[    1.234567] message\n". Returns the length.
+ */
+static int32_t
+klog_format_entry(const klog_entry_t *entry, int8_t *buf)
+{
+    uint32_t sec, usec;
+    klog_tsc_to_time(entry->tsc, &sec, &usec);
+
+    int32_t len = 0;
+    buf[len++] = '[';
+    len += klog_format_num(&buf[len], sec, 5, ' ');
+    buf[len++] = '.';
+    len += klog_format_num(&buf[len], usec, 6, '0');
+    buf[len++] = ']';
+    buf[len++] = ' ';
+    strcpy(&buf[len], entry->msg);
+    len += strlen(entry->msg);
+
+    /* Make sure every entry ends up on its own line */
+    if (len == 0 || buf[len - 1] != '\n') {
+        buf[len++] = '\n';
+    }
+    return len;
+}
+
+/*
+ * Open syscall for the klog device. Reading starts from
+ * the oldest message still in the log.
+ */
+int32_t
+klog_open(const uint8_t *filename, file_obj_t *file)
+{
+    /* File offset holds the sequence number of the next entry to read */
+    uint32_t next = klog_next;
+    file->offset = (next > KLOG_NUM_ENTRIES) ? next - KLOG_NUM_ENTRIES : 0;
+    return 0;
+}
+
+/*
+ * Read syscall for the klog device. Reads as many whole log
+ * lines as fit in the buffer. Returns 0 once all messages
+ * logged so far have been read. Messages that were overwritten
+ * before they could be read are skipped.
+ */
+int32_t
+klog_read(file_obj_t *file, void *buf, int32_t nbytes)
+{
+    uint8_t *dest = buf;
+    int32_t total = 0;
+    uint32_t seq = file->offset;
+    uint32_t next = klog_next;
+
+    /* Skip anything that has been overwritten */
+    if (next - seq > KLOG_NUM_ENTRIES) {
+        seq = next - KLOG_NUM_ENTRIES;
+    }
+
+    for (; seq != next; ++seq) {
+        /*
+         * Take a snapshot of the entry, and make sure it wasn't
+         * overwritten (or still being written) while we copied it
+         */
+        klog_entry_t *entry = &klog_ring[seq & (KLOG_NUM_ENTRIES - 1)];
+        klog_entry_t copy;
+        memcpy(&copy, entry, sizeof(copy));
+        if (copy.seq != seq + 1 || entry->seq != seq + 1) {
+            continue;
+        }
+        copy.msg[KLOG_MSG_SIZE - 1] = '\0';
+
+        int8_t line[KLOG_LINE_SIZE];
+        int32_t len = klog_format_entry(&copy, line);
+        if (total + len > nbytes) {
+            break;
+        }
+
+        if (!copy_to_user(&dest[total], line, len)) {
+            return -1;
+        }
+        total += len;
+    }
+
+    file->offset = seq;
+    return total;
+}
+
+/*
+ * Write syscall for the klog device. Adds the buffer to the
+ * log as a single informational message.
+ */
+int32_t
+klog_write(file_obj_t *file, const void *buf, int32_t nbytes)
+{
+    int8_t msg[KLOG_MSG_SIZE];
+    if (nbytes < 0) {
+        return -1;
+    }
+
+    int32_t len = (nbytes < KLOG_MSG_SIZE) ? nbytes : KLOG_MSG_SIZE - 1;
+    if (!copy_from_user(msg, buf, len)) {
+        return -1;
+    }
+    msg[len] = '\0';
+
+    klog(KLOG_INFO, "%s", msg);
+    return nbytes;
+}
+
+/*
+ * Close syscall for the klog device. Does nothing.
+ */
+int32_t
+klog_close(file_obj_t *file)
+{
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef _KLOG_H
+#define _KLOG_H
+
+#include "types.h"
+#include "file.h"
+
+/* Log levels, most severe first */
+#define KLOG_ERR   0
+#define KLOG_WARN  1
+#define KLOG_INFO  2
+#define KLOG_DEBUG 3
+
+/* Number of entries in the log ring (must be a power of 2) */
+#define KLOG_NUM_ENTRIES 256
+
+/* Maximum length of a log message, including the NUL terminator */
+#define KLOG_MSG_SIZE 112
+
+#ifndef ASM
+
+/* Log ring entry */
+typedef struct {
+    /*
+     * Sequence number of this entry plus one. This is written
+     * last, so 0 or a stale value means the entry is not (yet)
+     * valid for the sequence number a reader is looking for.
+     */
+    volatile uint32_t seq;
+
+    /* TSC value when the message was logged */
+    uint64_t tsc;
+
+    /* Log level (one of the KLOG_* constants) */
+    uint8_t level;
+
+    /* NUL-terminated message text */
+    int8_t msg[KLOG_MSG_SIZE];
+} klog_entry_t;
+
+/* Adds a message to the kernel log */
+void klog(int32_t level, int8_t *format, ...);
+
+/* Sets whether log messages are also sent to the serial port */
+void klog_set_serial(bool enabled);
+
+/* Called on each PIT tick to calibrate timestamps */
+void klog_tick(void);
+
+/* klog device syscall handlers */
+int32_t klog_open(const uint8_t *filename, file_obj_t *file);
+int32_t klog_read(file_obj_t *file, void *buf, int32_t nbytes);
+int32_t klog_write(file_obj_t *file, const void *buf, int32_t nbytes);
+int32_t klog_close(file_obj_t *file);
+
+#endif /* ASM */
+
+#endif /* _KLOG_H */
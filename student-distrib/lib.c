@@ -14,34 +14,49 @@ clear(void)
     terminal_clear();
 }
 
-/* Standard printf().
- * Only supports the following format strings:
- * %%  - print a literal '%' character
- * %x  - print a number in hexadecimal
- * %u  - print a number as an unsigned integer
- * %d  - print a number as a signed integer
- * %c  - print a character
- * %s  - print a string
- * %#x - print a number in 32-bit aligned hexadecimal, i.e.
- *       print 8 hexadecimal digits, zero-padded on the left.
- *       For example, the hex number "E" would be printed as
- *       "0000000E".
- *       Note: This is slightly different than the libc specification
- *       for the "#" modifier (this implementation doesn't add a "0x" at
- *       the beginning), but I think it's more flexible this way.
- *       Also note: %x is the only conversion specifier that can use
- *       the "#" modifier to alter output.
+/*
+ * Destination for formatted output. If buf is NULL, output goes
+ * to the console; otherwise, it goes into buf, which holds size
+ * bytes. len counts every character produced, even those that
+ * didn't fit.
  */
-int32_t
-printf(int8_t *format, ...)
+typedef struct {
+    int8_t *buf;
+    uint32_t size;
+    uint32_t len;
+} format_out_t;
+
+/* Outputs a character for format_impl() */
+static void
+format_putc(format_out_t *out, uint8_t c)
+{
+    if (out->buf == NULL) {
+        putc(c);
+    } else if (out->len + 1 < out->size) {
+        out->buf[out->len] = c;
+    }
+    out->len++;
+}
+
+/* Outputs a string for format_impl() */
+static void
+format_puts(format_out_t *out, int8_t *s)
+{
+    while (*s != '\0') {
+        format_putc(out, *s++);
+    }
+}
+
+/*
+ * Formats a string. esp points to the first argument after
+ * the format string. See printf() for the supported formats.
+ */
+static int32_t
+format_impl(format_out_t *out, int8_t *format, int32_t *esp)
 {
     /* Pointer to the format string */
     int8_t* buf = format;
 
-    /* Stack pointer for the other parameters */
-    int32_t* esp = (void *)&format;
-    esp++;
-
     while(*buf != '\0') {
         switch(*buf) {
             case '%':
@@ -54,7 +69,7 @@ format_char_switch:
                     switch(*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%');
+                            format_putc(out, '%');
                             break;
 
                         /* Use alternate formatting */
@@ -72,7 +87,7 @@ format_char_switch:
                                 int8_t conv_buf[64];
                                 if(alternate == 0) {
                                     itoa(*((uint32_t *)esp), conv_buf, 16);
-                                    puts(conv_buf);
+                                    format_puts(out, conv_buf);
                                 } else {
                                     int32_t starting_index;
                                     int32_t i;
@@ -82,7 +97,7 @@ format_char_switch:
                                         conv_buf[i] = '0';
                                         i++;
                                     }
-                                    puts(&conv_buf[starting_index]);
+                                    format_puts(out, &conv_buf[starting_index]);
                                 }
                                 esp++;
                             }
@@ -93,7 +108,7 @@ format_char_switch:
                             {
                                 int8_t conv_buf[36];
                                 itoa(*((uint32_t *)esp), conv_buf, 10);
-                                puts(conv_buf);
+                                format_puts(out, conv_buf);
                                 esp++;
                             }
                             break;
@@ -109,20 +124,20 @@ format_char_switch:
                                 } else {
                                     itoa(value, conv_buf, 10);
                                 }
-                                puts(conv_buf);
+                                format_puts(out, conv_buf);
                                 esp++;
                             }
                             break;
 
                         /* Print a single character */
                         case 'c':
-                            putc( (uint8_t) *((int32_t *)esp) );
+                            format_putc(out, (uint8_t) *((int32_t *)esp) );
                             esp++;
                             break;
 
                         /* Print a NULL-terminated string */
                         case 's':
-                            puts( *((int8_t **)esp) );
+                            format_puts(out, *((int8_t **)esp) );
                             esp++;
                             break;
 
@@ -134,7 +149,7 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf);
+                format_putc(out, *buf);
                 break;
         }
         buf++;
@@ -143,6 +158,62 @@ format_char_switch:
     return (buf - format);
 }
 
+/* Standard printf().
+ * Only supports the following format strings:
+ * %%  - print a literal '%' character
+ * %x  - print a number in hexadecimal
+ * %u  - print a number as an unsigned integer
+ * %d  - print a number as a signed integer
+ * %c  - print a character
+ * %s  - print a string
+ * %#x - print a number in 32-bit aligned hexadecimal, i.e.
+ *       print 8 hexadecimal digits, zero-padded on the left.
+ *       For example, the hex number "E" would be printed as
+ *       "0000000E".
+ *       Note: This is slightly different than the libc specification
+ *       for the "#" modifier (this implementation doesn't add a "0x" at
+ *       the beginning), but I think it's more flexible this way.
+ *       Also note: %x is the only conversion specifier that can use
+ *       the "#" modifier to alter output.
+ */
+int32_t
+printf(int8_t *format, ...)
+{
+    /* Stack pointer for the other parameters */
+    int32_t* esp = (void *)&format;
+    esp++;
+
+    format_out_t out = {NULL, 0, 0};
+    return format_impl(&out, format, esp);
+}
+
+/*
+ * Formats a string into buf, which holds size bytes. The
+ * result is always NUL-terminated (if size > 0). args points
+ * to the first argument after the format string on the stack.
+ * Returns the length the formatted string would have had if
+ * buf were big enough.
+ */
+int32_t
+vsnprintf(int8_t *buf, uint32_t size, int8_t *format, int32_t *args)
+{
+    format_out_t out = {buf, size, 0};
+    format_impl(&out, format, args);
+    if (size > 0) {
+        buf[out.len < size ? out.len : size - 1] = '\0';
+    }
+    return out.len;
+}
+
+/* snprintf(), with the same formats as printf() */
+int32_t
+snprintf(int8_t *buf, uint32_t size, int8_t *format, ...)
+{
+    int32_t* esp = (void *)&format;
+    esp++;
+    return vsnprintf(buf, size, format, esp);
+}
+
 /*
  * int32_t puts(int8_t* s);
  *   Inputs: int_8* s = pointer to a string of characters
@@ -278,6 +349,24 @@ strrev(int8_t* s)
     return s;
 }
 
+/*
+ * Helpers for the word-at-a-time string functions. WORD_HAS_ZERO(w)
+ * is nonzero if any byte of w is zero. Only aligned words are ever
+ * read, so reading past the NUL terminator never crosses into
+ * another page.
+ */
+#define WORD_SIZE  4
+#define WORD_ONES  0x01010101
+#define WORD_HIGHS 0x80808080
+#define WORD_HAS_ZERO(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+#define WORD_ALIGNED(p) (((uint32_t)(p) & (WORD_SIZE - 1)) == 0)
+
+/* Words that may alias the bytes of a string */
+typedef uint32_t __attribute__((may_alias)) str_word_t;
+
+/* Same, but for (possibly unaligned) stores */
+typedef uint32_t __attribute__((may_alias, aligned(1))) str_uword_t;
+
 /*
  * uint32_t strlen(const int8_t* s);
  *   Inputs: const int8_t* s = string to take length of
@@ -287,56 +376,195 @@ strrev(int8_t* s)
 uint32_t
 strlen(const int8_t* s)
 {
-    register uint32_t len = 0;
-    while(s[len] != '\0')
-        len++;
+    const int8_t *p = s;
+    const str_word_t *w;
+
+    /* Check one byte at a time until we're aligned */
+    for (; !WORD_ALIGNED(p); p++) {
+        if (*p == '\0') {
+            return p - s;
+        }
+    }
+
+    /* Then a word at a time until one contains the NUL */
+    for (w = (const str_word_t *)p; !WORD_HAS_ZERO(*w); w++);
+
+    /* Find the NUL inside that word */
+    for (p = (const int8_t *)w; *p != '\0'; p++);
+    return p - s;
+}
+
+/*
+ * Copies and fills smaller than MEM_REP_SIZE use an unrolled
+ * loop, since the startup cost of rep movs/stos dominates there.
+ *
+ * Cycles (best of 50) from membench/membench, on a Xeon with ERMS,
+ * compared to the rep movsl/stosl versions these replaced. memmove
+ * is the backward (overlapping, dest > src) case, which used to be
+ * std; rep movsb. nt is a memset with non-temporal stores, and the
+ * cold columns flush the buffer out of the cache first.
+ *
+ *   bytes  memcpy   (old)  memmove     (old)  memset   (old)     (nt)  cold memset   (old)     (nt)
+ *   16         62   (118)       66     (246)      60   (128)     (98)           64   (128)    (104)
+ *   64         68   (120)       72     (286)      66   (126)    (102)           74   (128)    (110)
+ *   256        84   (122)       94     (446)      82   (128)    (162)           86   (128)    (132)
+ *   4K        138   (170)      548    (3670)     136   (172)    (912)          144   (176)    (604)
+ *   64K      2702  (3156)     9380   (55280)    3334  (3286)   (8662)        12170 (11496)   (8362)
+ *   1M      54088 (53822)   148538  (881604)   54316 (54300) (133114)       188302 (186574) (127010)
+ *   4M     379436 (395518)  654684 (3523670)  375414 (389876) (544564)      763262 (772480) (509748)
+ *
+ * Non-temporal stores only win for cold fills of 1MB and up. The
+ * largest fills the kernel does are the 4K pages cleared by
+ * paging_clear_process_page, where they lose, so memset doesn't
+ * use them.
+ */
+#define MEM_REP_SIZE 256
+
+/* CPUID feature bits */
+#define CPUID_EBX_ERMS 0x00000200 /* Leaf 7: fast rep movsb/stosb */
+
+/* Whether the features below have been detected yet */
+static bool mem_features_valid = false;
+
+/* CPU features used by the memory functions */
+static bool cpu_has_erms = false;
+
+/*
+ * Detects the CPU features used by the memory functions.
+ * This happens on first use, since memcpy and friends are
+ * called before anything else is initialized.
+ */
+static void
+mem_init_features(void)
+{
+    uint32_t max_leaf, eax, ebx, ecx, edx;
 
-    return len;
+    asm volatile("cpuid"
+                 : "=a"(max_leaf), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                 : "a"(0));
+
+    if (max_leaf >= 7) {
+        asm volatile("cpuid"
+                     : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                     : "a"(7), "c"(0));
+        cpu_has_erms = (ebx & CPUID_EBX_ERMS) != 0;
+    }
+
+    mem_features_valid = true;
 }
 
 /*
- * void* memset(void* s, int32_t c, uint32_t n);
- *   Inputs: void* s = pointer to memory
- *           int32_t c = value to set memory to
- *           uint32_t n = number of bytes to set
- *   Return Value: new string
- *   Function: set n consecutive bytes of pointer s to value c
+ * Fills n bytes at s with the repeated 4-byte word, 16 bytes
+ * at a time, for sizes where rep stos isn't worth starting up.
  */
-void*
-memset(void* s, int32_t c, uint32_t n)
+static void
+memset_unrolled(void *s, uint32_t word, uint32_t n)
 {
-    c &= 0xFF;
     asm volatile("                  \n\
-            .memset_top:            \n\
+            1:                      \n\
+            cmpl    $16, %%ecx      \n\
+            jb      2f              \n\
+            movl    %%eax, 0(%%edi) \n\
+            movl    %%eax, 4(%%edi) \n\
+            movl    %%eax, 8(%%edi) \n\
+            movl    %%eax, 12(%%edi) \n\
+            addl    $16, %%edi      \n\
+            subl    $16, %%ecx      \n\
+            jmp     1b              \n\
+            2:                      \n\
+            cmpl    $4, %%ecx       \n\
+            jb      3f              \n\
+            movl    %%eax, (%%edi)  \n\
+            addl    $4, %%edi       \n\
+            subl    $4, %%ecx       \n\
+            jmp     2b              \n\
+            3:                      \n\
             testl   %%ecx, %%ecx    \n\
-            jz      .memset_done    \n\
-            testl   $0x3, %%edi     \n\
-            jz      .memset_aligned \n\
+            jz      4f              \n\
             movb    %%al, (%%edi)   \n\
             addl    $1, %%edi       \n\
             subl    $1, %%ecx       \n\
-            jmp     .memset_top     \n\
-            .memset_aligned:        \n\
+            jmp     3b              \n\
+            4:                      \n\
+            "
+            : "+D"(s), "+c"(n)
+            : "a"(word)
+            : "memory", "cc"
+            );
+}
+
+/* Fills n bytes with rep stosb, for CPUs with ERMS */
+static void
+memset_erms(void *s, uint32_t word, uint32_t n)
+{
+    asm volatile("                  \n\
+            movw    %%ds, %%dx      \n\
+            movw    %%dx, %%es      \n\
+            cld                     \n\
+            rep     stosb           \n\
+            "
+            : "+D"(s), "+c"(n)
+            : "a"(word)
+            : "edx", "memory", "cc"
+            );
+}
+
+/*
+ * Fills n bytes with rep stosl, after aligning the
+ * destination, for CPUs without ERMS
+ */
+static void
+memset_rep(void *s, uint32_t word, uint32_t n)
+{
+    asm volatile("                  \n\
             movw    %%ds, %%dx      \n\
             movw    %%dx, %%es      \n\
+            cld                     \n\
+            1:                      \n\
+            testl   $0x3, %%edi     \n\
+            jz      2f              \n\
+            stosb                   \n\
+            subl    $1, %%ecx       \n\
+            jmp     1b              \n\
+            2:                      \n\
             movl    %%ecx, %%edx    \n\
             shrl    $2, %%ecx       \n\
             andl    $0x3, %%edx     \n\
-            cld                     \n\
             rep     stosl           \n\
-            .memset_bottom:         \n\
-            testl   %%edx, %%edx    \n\
-            jz      .memset_done    \n\
-            movb    %%al, (%%edi)   \n\
-            addl    $1, %%edi       \n\
-            subl    $1, %%edx       \n\
-            jmp     .memset_bottom  \n\
-            .memset_done:           \n\
+            movl    %%edx, %%ecx    \n\
+            rep     stosb           \n\
             "
-            :
-            : "a"(c << 24 | c << 16 | c << 8 | c), "D"(s), "c"(n)
+            : "+D"(s), "+c"(n)
+            : "a"(word)
             : "edx", "memory", "cc"
             );
+}
+
+/*
+ * void* memset(void* s, int32_t c, uint32_t n);
+ *   Inputs: void* s = pointer to memory
+ *           int32_t c = value to set memory to
+ *           uint32_t n = number of bytes to set
+ *   Return Value: new string
+ *   Function: set n consecutive bytes of pointer s to value c
+ */
+void*
+memset(void* s, int32_t c, uint32_t n)
+{
+    if (!mem_features_valid) {
+        mem_init_features();
+    }
+
+    c &= 0xFF;
+    uint32_t word = c << 24 | c << 16 | c << 8 | c;
+
+    if (n < MEM_REP_SIZE) {
+        memset_unrolled(s, word, n);
+    } else if (cpu_has_erms) {
+        memset_erms(s, word, n);
+    } else {
+        memset_rep(s, word, n);
+    }
 
     return s;
 }
@@ -391,52 +619,181 @@ memset_dword(void* s, int32_t c, uint32_t n)
     return s;
 }
 
+/* Copies n bytes with rep movsb, for CPUs with ERMS */
+static void
+memcpy_erms(void *dest, const void *src, uint32_t n)
+{
+    asm volatile("                  \n\
+            movw    %%ds, %%dx      \n\
+            movw    %%dx, %%es      \n\
+            cld                     \n\
+            rep     movsb           \n\
+            "
+            : "+D"(dest), "+S"(src), "+c"(n)
+            :
+            : "edx", "memory", "cc"
+            );
+}
+
 /*
- * void* memcpy(void* dest, const void* src, uint32_t n);
- *   Inputs: void* dest = destination of copy
- *           const void* src = source of copy
- *           uint32_t n = number of byets to copy
- *   Return Value: pointer to dest
- *   Function: copy n bytes of src to dest
+ * Copies n bytes with rep movsl, after aligning the
+ * destination, for CPUs without ERMS
  */
-void*
-memcpy(void* dest, const void* src, uint32_t n)
+static void
+memcpy_rep(void *dest, const void *src, uint32_t n)
 {
     asm volatile("                  \n\
-            .memcpy_top:            \n\
-            testl   %%ecx, %%ecx    \n\
-            jz      .memcpy_done    \n\
-            testl   $0x3, %%edi     \n\
-            jz      .memcpy_aligned \n\
-            movb    (%%esi), %%al   \n\
-            movb    %%al, (%%edi)   \n\
-            addl    $1, %%edi       \n\
-            addl    $1, %%esi       \n\
-            subl    $1, %%ecx       \n\
-            jmp     .memcpy_top     \n\
-            .memcpy_aligned:        \n\
             movw    %%ds, %%dx      \n\
             movw    %%dx, %%es      \n\
+            cld                     \n\
+            1:                      \n\
+            testl   $0x3, %%edi     \n\
+            jz      2f              \n\
+            movsb                   \n\
+            subl    $1, %%ecx       \n\
+            jmp     1b              \n\
+            2:                      \n\
             movl    %%ecx, %%edx    \n\
             shrl    $2, %%ecx       \n\
             andl    $0x3, %%edx     \n\
-            cld                     \n\
             rep     movsl           \n\
-            .memcpy_bottom:         \n\
-            testl   %%edx, %%edx    \n\
-            jz      .memcpy_done    \n\
+            movl    %%edx, %%ecx    \n\
+            rep     movsb           \n\
+            "
+            : "+D"(dest), "+S"(src), "+c"(n)
+            :
+            : "edx", "memory", "cc"
+            );
+}
+
+/*
+ * Copies n bytes forwards, 16 at a time, for sizes where
+ * rep movs isn't worth starting up. Each load is done before
+ * the store that could overlap it, so this is safe when dest
+ * is below src.
+ */
+static void
+memcpy_unrolled(void *dest, const void *src, uint32_t n)
+{
+    asm volatile("                  \n\
+            1:                      \n\
+            cmpl    $16, %%ecx      \n\
+            jb      2f              \n\
+            movl    0(%%esi), %%eax \n\
+            movl    4(%%esi), %%edx \n\
+            movl    %%eax, 0(%%edi) \n\
+            movl    %%edx, 4(%%edi) \n\
+            movl    8(%%esi), %%eax \n\
+            movl    12(%%esi), %%edx \n\
+            movl    %%eax, 8(%%edi) \n\
+            movl    %%edx, 12(%%edi) \n\
+            addl    $16, %%esi      \n\
+            addl    $16, %%edi      \n\
+            subl    $16, %%ecx      \n\
+            jmp     1b              \n\
+            2:                      \n\
+            cmpl    $4, %%ecx       \n\
+            jb      3f              \n\
+            movl    (%%esi), %%eax  \n\
+            movl    %%eax, (%%edi)  \n\
+            addl    $4, %%esi       \n\
+            addl    $4, %%edi       \n\
+            subl    $4, %%ecx       \n\
+            jmp     2b              \n\
+            3:                      \n\
+            testl   %%ecx, %%ecx    \n\
+            jz      4f              \n\
             movb    (%%esi), %%al   \n\
             movb    %%al, (%%edi)   \n\
-            addl    $1, %%edi       \n\
             addl    $1, %%esi       \n\
-            subl    $1, %%edx       \n\
-            jmp     .memcpy_bottom  \n\
-            .memcpy_done:           \n\
+            addl    $1, %%edi       \n\
+            subl    $1, %%ecx       \n\
+            jmp     3b              \n\
+            4:                      \n\
+            "
+            : "+D"(dest), "+S"(src), "+c"(n)
+            :
+            : "eax", "edx", "memory", "cc"
+            );
+}
+
+/*
+ * Copies n bytes backwards, a word at a time once the end of
+ * the destination is aligned. Used by memmove when dest is
+ * above src and the two overlap.
+ */
+static void
+memcpy_backward(void *dest, const void *src, uint32_t n)
+{
+    asm volatile("                  \n\
+            addl    %%ecx, %%esi    \n\
+            addl    %%ecx, %%edi    \n\
+            1:                      \n\
+            testl   %%ecx, %%ecx    \n\
+            jz      4f              \n\
+            testl   $0x3, %%edi     \n\
+            jz      2f              \n\
+            subl    $1, %%esi       \n\
+            subl    $1, %%edi       \n\
+            movb    (%%esi), %%al   \n\
+            movb    %%al, (%%edi)   \n\
+            subl    $1, %%ecx       \n\
+            jmp     1b              \n\
+            2:                      \n\
+            cmpl    $16, %%ecx      \n\
+            jb      3f              \n\
+            movl    -4(%%esi), %%eax \n\
+            movl    -8(%%esi), %%edx \n\
+            movl    %%eax, -4(%%edi) \n\
+            movl    %%edx, -8(%%edi) \n\
+            movl    -12(%%esi), %%eax \n\
+            movl    -16(%%esi), %%edx \n\
+            movl    %%eax, -12(%%edi) \n\
+            movl    %%edx, -16(%%edi) \n\
+            subl    $16, %%esi      \n\
+            subl    $16, %%edi      \n\
+            subl    $16, %%ecx      \n\
+            jmp     2b              \n\
+            3:                      \n\
+            testl   %%ecx, %%ecx    \n\
+            jz      4f              \n\
+            subl    $1, %%esi       \n\
+            subl    $1, %%edi       \n\
+            movb    (%%esi), %%al   \n\
+            movb    %%al, (%%edi)   \n\
+            subl    $1, %%ecx       \n\
+            jmp     3b              \n\
+            4:                      \n\
             "
+            : "+D"(dest), "+S"(src), "+c"(n)
             :
-            : "S"(src), "D"(dest), "c"(n)
             : "eax", "edx", "memory", "cc"
             );
+}
+
+/*
+ * void* memcpy(void* dest, const void* src, uint32_t n);
+ *   Inputs: void* dest = destination of copy
+ *           const void* src = source of copy
+ *           uint32_t n = number of byets to copy
+ *   Return Value: pointer to dest
+ *   Function: copy n bytes of src to dest. Always copies
+ *             forwards (memmove relies on this).
+ */
+void*
+memcpy(void* dest, const void* src, uint32_t n)
+{
+    if (!mem_features_valid) {
+        mem_init_features();
+    }
+
+    if (n < MEM_REP_SIZE) {
+        memcpy_unrolled(dest, src, n);
+    } else if (cpu_has_erms) {
+        memcpy_erms(dest, src, n);
+    } else {
+        memcpy_rep(dest, src, n);
+    }
 
     return dest;
 }
@@ -452,26 +809,53 @@ memcpy(void* dest, const void* src, uint32_t n)
 void*
 memmove(void* dest, const void* src, uint32_t n)
 {
-    asm volatile("                  \n\
-            movw    %%ds, %%dx      \n\
-            movw    %%dx, %%es      \n\
-            cld                     \n\
-            cmp     %%edi, %%esi    \n\
-            jae     .memmove_go     \n\
-            leal    -1(%%esi, %%ecx), %%esi    \n\
-            leal    -1(%%edi, %%ecx), %%edi    \n\
-            std                     \n\
-            .memmove_go:            \n\
-            rep     movsb           \n\
-            "
-            :
-            : "D"(dest), "S"(src), "c"(n)
-            : "edx", "memory", "cc"
-            );
+    /* A forward copy is fine unless dest overlaps the end of src */
+    if ((uint32_t)dest <= (uint32_t)src || (uint32_t)dest >= (uint32_t)src + n) {
+        return memcpy(dest, src, n);
+    }
 
+    memcpy_backward(dest, src, n);
     return dest;
 }
 
+/*
+ * void* memchr(const void* s, int32_t c, uint32_t n);
+ *   Inputs: const void* s = buffer to search
+ *           int32_t c = byte to search for
+ *           uint32_t n = number of bytes to search
+ *   Return Value: pointer to the first c in s, or NULL if there is none
+ *   Function: finds a byte in a buffer
+ */
+void*
+memchr(const void* s, int32_t c, uint32_t n)
+{
+    const uint8_t *p = s;
+    uint8_t ch = (uint8_t)c;
+
+    /* XORing with this turns each matching byte into zero */
+    uint32_t pattern = ch * WORD_ONES;
+
+    for (; n > 0 && !WORD_ALIGNED(p); p++, n--) {
+        if (*p == ch) {
+            return (void *)p;
+        }
+    }
+
+    /* Skip words that don't contain the byte */
+    for (; n >= WORD_SIZE; p += WORD_SIZE, n -= WORD_SIZE) {
+        if (WORD_HAS_ZERO(*(const str_word_t *)p ^ pattern)) {
+            break;
+        }
+    }
+
+    for (; n > 0; p++, n--) {
+        if (*p == ch) {
+            return (void *)p;
+        }
+    }
+    return NULL;
+}
+
 /*
  * int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
  *   Inputs: const int8_t* s1 = first string to compare
@@ -488,18 +872,34 @@ memmove(void* dest, const void* src, uint32_t n)
 int32_t
 strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
 {
-    int32_t i;
-    for(i=0; i<n; i++) {
-        if( (s1[i] != s2[i]) ||
-                (s1[i] == '\0') /* || s2[i] == '\0' */ ) {
+    /* Compare a word at a time if both strings align at once */
+    if (WORD_ALIGNED((uint32_t)s1 ^ (uint32_t)s2)) {
+        for (; n > 0 && !WORD_ALIGNED(s1); s1++, s2++, n--) {
+            if (*s1 != *s2 || *s1 == '\0') {
+                return *s1 - *s2;
+            }
+        }
+
+        /* Stop at the word holding a difference or the NUL */
+        for (; n >= WORD_SIZE; s1 += WORD_SIZE, s2 += WORD_SIZE, n -= WORD_SIZE) {
+            uint32_t w = *(const str_word_t *)s1;
+            if (w != *(const str_word_t *)s2 || WORD_HAS_ZERO(w)) {
+                break;
+            }
+        }
+    }
+
+    for (; n > 0; s1++, s2++, n--) {
+        if( (*s1 != *s2) ||
+                (*s1 == '\0') /* || *s2 == '\0' */ ) {
 
-            /* The s2[i] == '\0' is unnecessary because of the short-circuit
+            /* The *s2 == '\0' is unnecessary because of the short-circuit
              * semantics of 'if' expressions in C.  If the first expression
-             * (s1[i] != s2[i]) evaluates to false, that is, if s1[i] ==
-             * s2[i], then we only need to test either s1[i] or s2[i] for
+             * (*s1 != *s2) evaluates to false, that is, if *s1 ==
+             * *s2, then we only need to test either *s1 or *s2 for
              * '\0', since we know they are equal. */
 
-            return s1[i] - s2[i];
+            return *s1 - *s2;
         }
     }
     return 0;
@@ -520,6 +920,23 @@ strncmp(const int8_t* s1, const int8_t* s2, uint32_t n)
 int32_t
 strcmp(const int8_t *s1, const int8_t *s2)
 {
+    /* Compare a word at a time if both strings align at once */
+    if (WORD_ALIGNED((uint32_t)s1 ^ (uint32_t)s2)) {
+        for (; !WORD_ALIGNED(s1); s1++, s2++) {
+            if (*s1 != *s2 || *s1 == '\0') {
+                return *(uint8_t *)s1 - *(uint8_t *)s2;
+            }
+        }
+
+        /* Stop at the word holding a difference or the NUL */
+        for (;; s1 += WORD_SIZE, s2 += WORD_SIZE) {
+            uint32_t w = *(const str_word_t *)s1;
+            if (w != *(const str_word_t *)s2 || WORD_HAS_ZERO(w)) {
+                break;
+            }
+        }
+    }
+
     while (*s1 && (*s1 == *s2)) {
         s1++;
         s2++;
@@ -537,13 +954,26 @@ strcmp(const int8_t *s1, const int8_t *s2)
 int8_t*
 strcpy(int8_t* dest, const int8_t* src)
 {
-    int32_t i=0;
-    while(src[i] != '\0') {
-        dest[i] = src[i];
-        i++;
+    int8_t *d = dest;
+    const str_word_t *w;
+
+    /* Copy one byte at a time until the source is aligned */
+    for (; !WORD_ALIGNED(src); d++, src++) {
+        if ((*d = *src) == '\0') {
+            return dest;
+        }
+    }
+
+    /*
+     * Copy whole words until reaching the one with the NUL. The
+     * destination might not be aligned, but x86 doesn't mind.
+     */
+    for (w = (const str_word_t *)src; !WORD_HAS_ZERO(*w); w++, d += WORD_SIZE) {
+        *(str_uword_t *)d = *w;
     }
 
-    dest[i] = '\0';
+    /* Copy what's left, up to and including the NUL */
+    for (src = (const int8_t *)w; (*d = *src) != '\0'; d++, src++);
     return dest;
 }
 
@@ -572,29 +1002,50 @@ strncpy(int8_t* dest, const int8_t* src, uint32_t n)
     return dest;
 }
 
-/* Checks whether a userspace string is readable */
-bool
-is_user_readable_string(const uint8_t *str)
+/*
+ * Finds the length of a userspace string, looking at no more than
+ * n characters. Returns -1 if the string isn't terminated within
+ * n characters, or runs into memory that userspace can't read.
+ */
+static int32_t
+user_strnlen(const uint8_t *str, uint32_t n)
 {
-    /* Ensure string starts inside the user page */
-    if ((uint32_t)str < USER_PAGE_START) {
-        return false;
-    }
+    uint32_t start = (uint32_t)str;
+    uint32_t addr = start;
+    while (addr - start < n) {
+        /* Check one page at a time, so we stop at unmapped ones */
+        uint32_t page_end = (addr | (KB(4) - 1)) + 1;
+        uint32_t limit = start + n;
+        if (page_end != 0 && (limit < start || page_end < limit)) {
+            limit = page_end;
+        }
+        if (paging_user_extent(addr, limit, false) != limit) {
+            return -1;
+        }
 
-    int32_t i;
-    for (i = 0; (uint32_t)str + i < USER_PAGE_END; ++i) {
-        if (str[i] == '\0') {
-            return true;
+        const uint8_t *nul = memchr((const uint8_t *)addr, '\0', limit - addr);
+        if (nul != NULL) {
+            return nul - str;
         }
+        addr = limit;
     }
 
-    /* Hit the end of the page w/o seeing a NUL terminator */
-    return false;
+    return -1;
 }
 
-/* Checks whether a userspace buffer is readable */
+/* Checks whether a userspace string is readable */
 bool
-is_user_readable(const void *user_buf, int32_t n)
+is_user_readable_string(const uint8_t *str)
+{
+    return user_strnlen(str, 0xffffffff) >= 0;
+}
+
+/*
+ * Checks whether userspace can access a buffer, and write to it
+ * if write is true.
+ */
+static bool
+is_user_accessible(const void *user_buf, int32_t n, bool write)
 {
     /* Buffer size must be non-negative */
     if (n < 0) {
@@ -609,28 +1060,25 @@ is_user_readable(const void *user_buf, int32_t n)
         return false;
     }
 
-    /*
-     * Buffer must start and end inside the user page.
-     * This is kind of a hacky way to determine whether the
-     * buffer is valid, but the only other alternative is
-     * EAFP which is much worse.
-     */
-    if (start < USER_PAGE_START || end >= USER_PAGE_END) {
-        return false;
-    }
+    /* The page tables know what the process can get to */
+    return paging_user_extent(start, end, write) == end;
+}
 
-    return true;
+/* Checks whether a userspace buffer is readable */
+bool
+is_user_readable(const void *user_buf, int32_t n)
+{
+    return is_user_accessible(user_buf, n, false);
 }
 
-/* Checks whether a userspace buffer is writable */
+/*
+ * Checks whether a userspace buffer is writable. Code pages
+ * are read-only, even though the kernel could write to them.
+ */
 bool
 is_user_writable(const void *user_buf, int32_t n)
 {
-    /*
-     * Everything is in one massive R/W/X page, so we don't
-     * distingush readable and writable memory blocks
-     */
-    return is_user_readable(user_buf, n);
+    return is_user_accessible(user_buf, n, true);
 }
 
 /*
@@ -641,7 +1089,7 @@ is_user_writable(const void *user_buf, int32_t n)
 int32_t
 read_char_from_user(const uint8_t *ptr)
 {
-    if ((uint32_t)ptr < USER_PAGE_START || (uint32_t)ptr >= USER_PAGE_END) {
+    if (!is_user_readable(ptr, 1)) {
         return -1;
     }
 
@@ -657,29 +1105,14 @@ read_char_from_user(const uint8_t *ptr)
 bool
 strncpy_from_user(uint8_t *dest, const uint8_t *src, uint32_t n)
 {
-    /*
-     * Make sure we start in the user page
-     * (The upper bound check is in the loop)
-     */
-    if ((uint32_t)src < USER_PAGE_START) {
+    /* Didn't reach the terminator before n characters */
+    int32_t len = user_strnlen(src, n);
+    if (len < 0) {
         return false;
     }
 
-    uint32_t i;
-    for (i = 0; i < n; ++i) {
-        /* Stop at the end of the user page */
-        if ((uint32_t)(src + i) >= USER_PAGE_END) {
-            return false;
-        }
-
-        /* Copy character, stop after reaching NUL terminator */
-        if ((dest[i] = src[i]) == '\0') {
-            return true;
-        }
-    }
-
-    /* Didn't reach the terminator before n characters */
-    return false;
+    memcpy(dest, src, len + 1);
+    return true;
 }
 
 /*
@@ -4,6 +4,8 @@
 #include "types.h"
 
 int32_t printf(int8_t *format, ...);
+int32_t snprintf(int8_t *buf, uint32_t size, int8_t *format, ...);
+int32_t vsnprintf(int8_t *buf, uint32_t size, int8_t *format, int32_t *args);
 void putc(uint8_t c);
 int32_t puts(int8_t *s);
 int32_t *atoi_s(const int8_t *value, int32_t *out_result);
@@ -17,6 +19,7 @@ void* memset_word(void* s, int32_t c, uint32_t n);
 void* memset_dword(void* s, int32_t c, uint32_t n);
 void* memcpy(void* dest, const void* src, uint32_t n);
 void* memmove(void* dest, const void* src, uint32_t n);
+void* memchr(const void* s, int32_t c, uint32_t n);
 int32_t strcmp(const int8_t* s1, const int8_t* s2);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
@@ -93,7 +96,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile("outl  %l1, (%w0)"     \
+    asm volatile("outl  %k1, (%w0)"     \
             :                           \
             : "d" (port), "a" (data)    \
             : "memory", "cc" );         \
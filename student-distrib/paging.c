@@ -1,6 +1,7 @@
 #include "paging.h"
 #include "debug.h"
-#include "terminal.h"
+#include "lib.h"
+#include "process.h"
 
 #define SIZE_4KB 0
 #define SIZE_4MB 1
@@ -13,20 +14,111 @@
 
 #define ALIGN_4KB __attribute__((aligned(KB(4))))
 
+/* PAT MSR and CPUID feature bit */
+#define PAT_MSR 0x277
+#define CPUID_EDX_PAT 0x00010000
+
+/* PAT memory type encodings */
+#define PAT_UC       0x00
+#define PAT_WC       0x01
+#define PAT_WT       0x04
+#define PAT_WB       0x06
+#define PAT_UC_MINUS 0x07
+
+/*
+ * PAT layout. This is the power-on default except that entry 1
+ * (PWT = 1, PCD = 0) is write-combining instead of write-through,
+ * which is what Linux does too. Entries 4-7 mirror 0-3, so the
+ * PAT bit in page table entries is left clear.
+ */
+#define PAT_VALUE_LO ((PAT_WB << 0) | (PAT_WC << 8) | (PAT_UC_MINUS << 16) | (PAT_UC << 24))
+#define PAT_VALUE_HI ((PAT_WB << 0) | (PAT_WT << 8) | (PAT_UC_MINUS << 16) | (PAT_UC << 24))
+
+/* Whether the CPU supports the PAT (and thus write-combining) */
+static bool pat_enabled = false;
+
 /* Page directory */
 static ALIGN_4KB page_dir_entry_t page_dir[NUM_PDE];
 
 /* Page table for first 4MB of memory */
 static ALIGN_4KB page_table_entry_4kb_t page_table[NUM_PTE];
 
-/* Page table for vidmap area */
+/*
+ * Page tables for the user page, one for each process. Each maps
+ * the process's 4MB block of physical memory, 4KB at a time so
+ * that pages can be made read-only.
+ */
+static ALIGN_4KB page_table_entry_4kb_t page_table_user[MAX_PROCESSES][NUM_PTE];
+
+/* Page table for vidmap and shared library area */
 static ALIGN_4KB page_table_entry_4kb_t page_table_vidmap[NUM_PTE];
 
+/* Virtual address of the video memory the vidmap page points to */
+static uint8_t *vidmap_video_mem = NULL;
+
 /* Helpful macros to access page table stuff */
 #define DIR_4KB(addr) (&page_dir[TO_DIR_INDEX(addr)].dir_4kb)
 #define DIR_4MB(addr) (&page_dir[TO_DIR_INDEX(addr)].dir_4mb)
 #define TABLE(addr) (&page_table[TO_TABLE_INDEX(addr)])
 #define TABLE_VIDMAP(addr) (&page_table_vidmap[TO_TABLE_INDEX(addr)])
+#define TABLE_USER(pid, addr) (&page_table_user[pid][TO_TABLE_INDEX(addr)])
+
+/*
+ * Sets the memory type bits of a page table entry. If the
+ * CPU doesn't have a PAT, write-combining pages fall back
+ * to being uncacheable.
+ */
+static void
+paging_set_entry_type(page_table_entry_4kb_t *table, page_mem_type_t type)
+{
+    if (type == PAGE_TYPE_WC && !pat_enabled) {
+        type = PAGE_TYPE_UC;
+    }
+
+    switch (type) {
+    case PAGE_TYPE_WB:
+        table->write_through = 0;
+        table->cache_disabled = 0;
+        break;
+    case PAGE_TYPE_WC:
+        table->write_through = 1;
+        table->cache_disabled = 0;
+        break;
+    case PAGE_TYPE_UC:
+        table->write_through = 1;
+        table->cache_disabled = 1;
+        break;
+    default:
+        ASSERT(0);
+        break;
+    }
+    table->page_attr_idx = 0;
+}
+
+/*
+ * Checks whether the CPU supports the PAT, and if so,
+ * programs it with our layout. This must be called before
+ * any page table entries are initialized.
+ */
+static void
+paging_init_pat(void)
+{
+    uint32_t features;
+    asm volatile("cpuid"
+                 : "=d"(features)
+                 : "a"(1)
+                 : "ebx", "ecx");
+
+    if (!(features & CPUID_EDX_PAT)) {
+        debugf("PAT not supported, frame buffers will be uncached\n");
+        return;
+    }
+
+    asm volatile("wrmsr"
+                 :
+                 : "c"(PAT_MSR), "a"(PAT_VALUE_LO), "d"(PAT_VALUE_HI));
+    pat_enabled = true;
+}
 
 /* Initializes the 4MB kernel page */
 static void
@@ -49,44 +141,65 @@ paging_init_video(void)
     dir->present = 1;
     dir->write = 1;
     dir->user = 0;
-    dir->cache_disabled = 1;
     dir->size = SIZE_4KB;
     dir->global = 1;
     dir->base_addr = TO_4KB_BASE(page_table);
 
-    /* Global (VGA) video memory page */
-    page_table_entry_4kb_t *global_table = TABLE(VIDEO_PAGE_START);
-    global_table->present = 1;
-    global_table->write = 1;
-    global_table->user = 0;
-    global_table->cache_disabled = 1;
-    global_table->global = 1;
-    global_table->base_addr = TO_4KB_BASE(VIDEO_PAGE_START);
-
-    /* Virtual video memory pages, one per terminal */
-    int32_t i;
-    for (i = 0; i < NUM_TERMINALS; ++i) {
-        uint32_t term_addr = TERMINAL_PAGE_START + i * KB(4);
-        page_table_entry_4kb_t *term_table = TABLE(term_addr);
-        term_table->present = 1;
-        term_table->write = 1;
-        term_table->user = 0;
-        term_table->cache_disabled = 1;
-        term_table->global = 1;
-        term_table->base_addr = TO_4KB_BASE(term_addr);
-    }
-}
-
-/* Initializes the 4MB user page */
+    /*
+     * VGA text memory pages. Each terminal keeps its screen
+     * resident in its own region of these, so they must all
+     * be mapped.
+     */
+    uint32_t addr;
+    for (addr = VIDEO_PAGE_START; addr < VIDEO_PAGE_END; addr += KB(4)) {
+        page_table_entry_4kb_t *table = TABLE(addr);
+        table->present = 1;
+        table->write = 1;
+        table->user = 0;
+        table->global = 1;
+        table->base_addr = TO_4KB_BASE(addr);
+    }
+
+    /*
+     * The VGA aperture is a frame buffer, so let writes to it
+     * be combined. We never read it back in a way that cares
+     * about ordering with other stores, and the port I/O done
+     * to update the CRTC drains the write-combining buffers.
+     */
+    paging_set_mem_type(VIDEO_PAGE_START, VIDEO_PAGE_END, PAGE_TYPE_WC);
+}
+
+/* Initializes the 4KB user pages */
 static void
 paging_init_user(void)
 {
-    page_dir_entry_4mb_t *dir = DIR_4MB(USER_PAGE_START);
+    page_dir_entry_4kb_t *dir = DIR_4KB(USER_PAGE_START);
     dir->present = 1;
     dir->write = 1;
     dir->user = 1;
-    dir->size = SIZE_4MB;
+    dir->size = SIZE_4KB;
     dir->global = 0;
+    dir->base_addr = TO_4KB_BASE(page_table_user[0]);
+
+    /*
+     * Each process has its own 4MB block of physical memory above
+     * 8MB. The pages start out dirty, since we don't know what's
+     * in them; see paging_clear_process_page.
+     */
+    int32_t pid;
+    uint32_t addr;
+    for (pid = 0; pid < MAX_PROCESSES; ++pid) {
+        uint32_t phys_addr = PROCESS_PHYS_START + pid * PROCESS_PHYS_SIZE;
+        for (addr = USER_PAGE_START; addr < USER_PAGE_END; addr += KB(4)) {
+            page_table_entry_4kb_t *table = TABLE_USER(pid, addr);
+            table->present = 1;
+            table->write = 1;
+            table->user = 1;
+            table->dirty = 1;
+            table->global = 0;
+            table->base_addr = TO_4KB_BASE(phys_addr + (addr - USER_PAGE_START));
+        }
+    }
 }
 
 /* Initializes the 4KB vidmap page */
@@ -97,16 +210,16 @@ paging_init_vidmap(void)
     dir->present = 1;
     dir->write = 1;
     dir->user = 1;
-    dir->cache_disabled = 1;
     dir->size = SIZE_4KB;
     dir->global = 0;
     dir->base_addr = TO_4KB_BASE(page_table_vidmap);
 
+    /* This always points into VGA memory, same as above */
     page_table_entry_4kb_t *table = TABLE_VIDMAP(VIDMAP_PAGE_START);
     table->present = 0;
     table->write = 1;
     table->user = 1;
-    table->cache_disabled = 1;
+    paging_set_entry_type(table, PAGE_TYPE_WC);
 }
 
 /*
@@ -156,6 +269,10 @@ paging_enable(void)
     ASSERT(((uint32_t)page_dir          & 0xfff) == 0);
     ASSERT(((uint32_t)page_table        & 0xfff) == 0);
     ASSERT(((uint32_t)page_table_vidmap & 0xfff) == 0);
+    ASSERT(((uint32_t)page_table_user   & 0xfff) == 0);
+
+    /* Set up memory types */
+    paging_init_pat();
 
     /* Initialize page table entries */
     paging_init_kernel();
@@ -167,6 +284,26 @@ paging_enable(void)
     paging_init_registers();
 }
 
+/*
+ * Sets the memory type of the kernel pages in [start, end),
+ * which must be page-aligned and lie in the first 4MB of
+ * memory.
+ */
+void
+paging_set_mem_type(uint32_t start, uint32_t end, page_mem_type_t type)
+{
+    ASSERT((start & 0xfff) == 0 && (end & 0xfff) == 0);
+    ASSERT(start <= end && end <= MB(4));
+
+    uint32_t addr;
+    for (addr = start; addr < end; addr += KB(4)) {
+        paging_set_entry_type(TABLE(addr), type);
+    }
+
+    /* Flush the TLB so the new types take effect */
+    paging_flush_tlb();
+}
+
 /*
  * Updates the process page to point to the block of
  * physical memory corresponding to the specified process.
@@ -175,31 +312,234 @@ paging_enable(void)
 void
 paging_update_process_page(int32_t pid)
 {
-    ASSERT(pid >= 0);
+    ASSERT(pid >= 0 && pid < MAX_PROCESSES);
 
-    /* Each process page is mapped starting from 8MB, each 4MB */
-    uint32_t phys_addr = MB(pid * 4 + 8);
-
-    /* Point the user page to the corresponding physical address */
-    DIR_4MB(USER_PAGE_START)->base_addr = TO_4MB_BASE(phys_addr);
+    /* Point the user page at the process's page table */
+    DIR_4KB(USER_PAGE_START)->base_addr = TO_4KB_BASE(page_table_user[pid]);
 
     /* Flush the TLB */
     paging_flush_tlb();
 }
 
 /*
- * Updates the vidmap page to point to the specified address.
- * If present is false, the vidmap page is disabled. Returns
- * the virtual address of the vidmap page.
+ * Clears the process page before a new program is loaded into
+ * it, and makes it all writable again. Only the pages that have
+ * been written since they were last cleared (which the CPU marks
+ * dirty) need to be zeroed. The process page must be current.
+ */
+void
+paging_clear_process_page(int32_t pid)
+{
+    ASSERT(pid >= 0 && pid < MAX_PROCESSES);
+    ASSERT(DIR_4KB(USER_PAGE_START)->base_addr == TO_4KB_BASE(page_table_user[pid]));
+
+    uint32_t addr;
+    for (addr = USER_PAGE_START; addr < USER_PAGE_END; addr += KB(4)) {
+        page_table_entry_4kb_t *table = TABLE_USER(pid, addr);
+        if (table->dirty) {
+            memset((uint8_t *)addr, 0, KB(4));
+        }
+        table->write = 1;
+    }
+
+    /*
+     * Clear the dirty bits only after zeroing, which set them
+     * again, and flush so the CPU can't use stale TLB entries
+     * that think the pages are still dirty.
+     */
+    for (addr = USER_PAGE_START; addr < USER_PAGE_END; addr += KB(4)) {
+        TABLE_USER(pid, addr)->dirty = 0;
+    }
+    paging_flush_tlb();
+}
+
+/*
+ * Sets whether the pages of the process page that overlap
+ * [start, end) are writable from userspace. The kernel can
+ * still write to them.
+ */
+void
+paging_set_process_writable(int32_t pid, uint32_t start, uint32_t end, bool write)
+{
+    ASSERT(pid >= 0 && pid < MAX_PROCESSES);
+    ASSERT(start >= USER_PAGE_START && start <= end && end <= USER_PAGE_END);
+
+    uint32_t addr;
+    for (addr = start & ~(KB(4) - 1); addr < end; addr += KB(4)) {
+        TABLE_USER(pid, addr)->write = write ? 1 : 0;
+    }
+
+    paging_flush_tlb();
+}
+
+/*
+ * Finds how much of [start, end) userspace can access, through
+ * the current page tables. Returns the first address that it
+ * can't access (or can't write to, if write is true), or end
+ * if it can access all of it.
+ */
+uint32_t
+paging_user_extent(uint32_t start, uint32_t end, bool write)
+{
+    if (end < start) {
+        return start;
+    }
+
+    uint32_t addr = start;
+    while (addr < end) {
+        page_dir_entry_4kb_t *dir = DIR_4KB(addr);
+        if (!dir->present || !dir->user || (write && !dir->write)) {
+            return addr;
+        }
+
+        uint32_t next;
+        if (dir->size == SIZE_4MB) {
+            next = (addr & ~(MB(4) - 1)) + MB(4);
+        } else {
+            /* Page tables are in kernel memory, which is identity-mapped */
+            page_table_entry_4kb_t *table = (page_table_entry_4kb_t *)(dir->base_addr << 12);
+            table = &table[TO_TABLE_INDEX(addr)];
+            if (!table->present || !table->user || (write && !table->write)) {
+                return addr;
+            }
+            next = (addr & ~(KB(4) - 1)) + KB(4);
+        }
+
+        /* Reached the top of memory */
+        if (next == 0) {
+            break;
+        }
+        addr = next;
+    }
+
+    return end;
+}
+
+/*
+ * Updates the vidmap page to point to the specified address,
+ * which must lie in the VGA text memory pages. If present is
+ * false, the vidmap page is disabled.
  */
 void
 paging_update_vidmap_page(uint8_t *video_mem, bool present)
 {
-    /* Update page table structures */
+    ASSERT((uint32_t)video_mem >= VIDEO_PAGE_START);
+    ASSERT((uint32_t)video_mem < VIDEO_PAGE_END);
+
+    /*
+     * Point at whatever physical page currently backs the
+     * kernel's view of that address (see below).
+     */
     page_table_entry_4kb_t *table = TABLE_VIDMAP(VIDMAP_PAGE_START);
+    page_table_entry_4kb_t *video = TABLE(video_mem);
     table->present = present ? 1 : 0;
-    table->base_addr = TO_4KB_BASE(video_mem);
+    table->base_addr = video->base_addr;
+    table->write_through = video->write_through;
+    table->cache_disabled = video->cache_disabled;
+    vidmap_video_mem = video_mem;
 
     /* Also flush the TLB */
     paging_flush_tlb();
 }
+
+/*
+ * Maps the shared library code at SHLIB_PAGE_START into every
+ * process, read-only. text must be page-aligned and lie in
+ * kernel memory; size is rounded up to whole pages.
+ */
+void
+paging_map_shlib(uint8_t *text, uint32_t size)
+{
+    ASSERT(((uint32_t)text & 0xfff) == 0);
+    ASSERT(size <= SHLIB_PAGE_END - SHLIB_PAGE_START);
+
+    uint32_t offset;
+    for (offset = 0; offset < size; offset += KB(4)) {
+        page_table_entry_4kb_t *table = TABLE_VIDMAP(SHLIB_PAGE_START + offset);
+        table->present = 1;
+        table->write = 0;
+        table->user = 1;
+        table->global = 1;
+        table->base_addr = TO_4KB_BASE(text + offset);
+        paging_set_entry_type(table, PAGE_TYPE_WB);
+    }
+
+    paging_flush_tlb();
+}
+
+/*
+ * Points the VGA text memory pages at the specified buffer,
+ * which must be page-aligned, lie in kernel memory, and be
+ * (VIDEO_PAGE_END - VIDEO_PAGE_START) bytes long. This is
+ * used to keep the terminals running while the display is
+ * in a graphics mode, where the text memory isn't reachable.
+ * If mem is NULL, the pages point at VGA memory again. The
+ * caller is responsible for copying the contents across.
+ */
+void
+paging_set_video_backing(uint8_t *mem)
+{
+    ASSERT(((uint32_t)mem & 0xfff) == 0);
+
+    uint32_t addr;
+    for (addr = VIDEO_PAGE_START; addr < VIDEO_PAGE_END; addr += KB(4)) {
+        page_table_entry_4kb_t *table = TABLE(addr);
+        if (mem == NULL) {
+            table->base_addr = TO_4KB_BASE(addr);
+            paging_set_entry_type(table, PAGE_TYPE_WC);
+        } else {
+            table->base_addr = TO_4KB_BASE(mem + (addr - VIDEO_PAGE_START));
+            paging_set_entry_type(table, PAGE_TYPE_WB);
+        }
+    }
+
+    /* The vidmap page has to follow along */
+    if (vidmap_video_mem != NULL) {
+        bool present = TABLE_VIDMAP(VIDMAP_PAGE_START)->present;
+        paging_update_vidmap_page(vidmap_video_mem, present);
+    } else {
+        paging_flush_tlb();
+    }
+}
+
+/*
+ * Identity-maps the linear frame buffer at [addr, addr + size)
+ * into kernel memory using 4MB pages, write-combined. addr must
+ * be 4MB-aligned and must not overlap anything that is already
+ * mapped. Returns false if it does.
+ */
+bool
+paging_map_framebuffer(uint32_t addr, uint32_t size)
+{
+    uint32_t end = addr + size;
+    uint32_t page;
+
+    if ((addr & (MB(4) - 1)) != 0 || end < addr) {
+        return false;
+    }
+
+    /* Make sure we aren't clobbering anything */
+    for (page = addr; page < end && page >= addr; page += MB(4)) {
+        if (DIR_4MB(page)->present) {
+            return false;
+        }
+    }
+
+    for (page = addr; page < end && page >= addr; page += MB(4)) {
+        page_dir_entry_4mb_t *dir = DIR_4MB(page);
+        dir->present = 1;
+        dir->write = 1;
+        dir->user = 0;
+        dir->size = SIZE_4MB;
+        dir->global = 1;
+        dir->base_addr = TO_4MB_BASE(page);
+
+        /* Same encoding as paging_set_entry_type, see PAT_VALUE_LO */
+        dir->write_through = 1;
+        dir->cache_disabled = pat_enabled ? 0 : 1;
+        dir->page_attr_idx = 0;
+    }
+
+    paging_flush_tlb();
+    return true;
+}
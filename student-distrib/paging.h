@@ -10,11 +10,13 @@
 /* number of entries in page table */
 #define NUM_PTE 1024
 
-#define VIDEO_PAGE_START    0x000B8000
-#define VIDEO_PAGE_END      0x000B9000
-
-#define TERMINAL_PAGE_START 0x000BA000
-/* End point is determined by the number of terminals */
+/*
+ * The whole 128KB VGA memory window, carved up between the terminals.
+ * terminal_init() selects this window instead of the usual 32KB at
+ * 0xB8000 so there is room for more terminals.
+ */
+#define VIDEO_PAGE_START    0x000A0000
+#define VIDEO_PAGE_END      0x000C0000
 
 #define KERNEL_PAGE_START   0x00400000
 #define KERNEL_PAGE_END     0x00800000
@@ -22,13 +24,35 @@
 #define USER_PAGE_START     0x08000000
 #define USER_PAGE_END       0x08400000
 
+/* Each process's user page is backed by its own 4MB block from here up */
+#define PROCESS_PHYS_START  0x00800000
+#define PROCESS_PHYS_SIZE   0x00400000
+
 #define VIDMAP_PAGE_START   0x084B8000
 #define VIDMAP_PAGE_END     0x084B9000
 
+/*
+ * The shared library's code is mapped read-only above the user
+ * page, the same in every process, leaving a gap so that running
+ * off the top of the stack still faults. Its data lives in each
+ * process's own page, below where executables are loaded.
+ */
+#define SHLIB_PAGE_START    0x08480000
+#define SHLIB_PAGE_END      0x08490000
+#define SHLIB_DATA_START    0x08000000
+#define SHLIB_DATA_END      0x08048000
+
 #ifndef ASM
 
 #include "types.h"
 
+/* Memory types that can be assigned to a page */
+typedef enum {
+    PAGE_TYPE_WB, /* Write-back, for ordinary RAM */
+    PAGE_TYPE_WC, /* Write-combining, for frame buffers */
+    PAGE_TYPE_UC, /* Uncacheable, for memory-mapped registers */
+} page_mem_type_t;
+
 /* Structure for 4KB page table entry */
 typedef struct {
     uint8_t present        : 1;
@@ -85,12 +109,33 @@ typedef union {
 /* Enables paging */
 void paging_enable(void);
 
+/* Sets the memory type of kernel pages in the first 4MB */
+void paging_set_mem_type(uint32_t start, uint32_t end, page_mem_type_t type);
+
 /* Updates the process page */
 void paging_update_process_page(int32_t pid);
 
+/* Zeroes the process page and makes it writable, before loading a program */
+void paging_clear_process_page(int32_t pid);
+
+/* Sets whether the pages covering [start, end) in the process page are writable */
+void paging_set_process_writable(int32_t pid, uint32_t start, uint32_t end, bool write);
+
+/* Finds how much of [start, end) userspace can access */
+uint32_t paging_user_extent(uint32_t start, uint32_t end, bool write);
+
 /* Updates the vidmap page to point to the specified address */
 void paging_update_vidmap_page(uint8_t *video_mem, bool present);
 
+/* Maps the shared library code into every process */
+void paging_map_shlib(uint8_t *text, uint32_t size);
+
+/* Points the VGA text memory pages at a RAM buffer, or back at VGA */
+void paging_set_video_backing(uint8_t *mem);
+
+/* Maps a linear frame buffer into kernel memory, write-combined */
+bool paging_map_framebuffer(uint32_t addr, uint32_t size);
+
 #endif /* ASM */
 
 #endif /* _PAGING_H */
@@ -0,0 +1,43 @@
+#include "pci.h"
+#include "lib.h"
+
+/*
+ * Reads a 32-bit register from the configuration space of
+ * the specified device, using configuration mechanism #1.
+ * offset must be 4-byte aligned.
+ */
+uint32_t
+pci_read_config(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset)
+{
+    uint32_t address = (1 << 31) |
+                       (bus << 16) |
+                       (dev << 11) |
+                       (func << 8) |
+                       (offset & 0xfc);
+    outl(address, PCI_PORT_ADDRESS);
+    return inl(PCI_PORT_DATA);
+}
+
+/*
+ * Finds a device with the specified vendor and device ID on
+ * bus 0 (which is all we need for the emulated devices we
+ * care about). Only function 0 is checked. Returns the device
+ * number, or -1 if not found.
+ */
+int32_t
+pci_find_device(uint16_t vendor, uint16_t device)
+{
+    int32_t dev;
+    for (dev = 0; dev < PCI_NUM_DEVICES; ++dev) {
+        uint32_t id = pci_read_config(0, dev, 0, PCI_REG_ID);
+        if ((id & 0xffff) == PCI_VENDOR_NONE) {
+            continue;
+        }
+
+        if ((id & 0xffff) == vendor && (id >> 16) == device) {
+            return dev;
+        }
+    }
+
+    return -1;
+}
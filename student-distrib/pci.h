@@ -0,0 +1,33 @@
+#ifndef _PCI_H
+#define _PCI_H
+
+#include "types.h"
+
+/* PCI configuration space access ports */
+#define PCI_PORT_ADDRESS 0xCF8
+#define PCI_PORT_DATA    0xCFC
+
+/* Configuration space register offsets */
+#define PCI_REG_ID   0x00 /* Vendor ID (low), device ID (high) */
+#define PCI_REG_BAR0 0x10
+
+/* Number of devices per bus */
+#define PCI_NUM_DEVICES 32
+
+/* Vendor ID read back for empty slots */
+#define PCI_VENDOR_NONE 0xFFFF
+
+/* Bits of memory BARs that aren't part of the address */
+#define PCI_BAR_MEM_FLAGS 0xF
+
+#ifndef ASM
+
+/* Reads a 32-bit configuration register */
+uint32_t pci_read_config(uint8_t bus, uint8_t dev, uint8_t func, uint8_t offset);
+
+/* Finds a device on bus 0 by vendor and device ID */
+int32_t pci_find_device(uint16_t vendor, uint16_t device);
+
+#endif /* ASM */
+
+#endif /* _PCI_H */
@@ -2,6 +2,8 @@
 #include "lib.h"
 #include "irq.h"
 #include "process.h"
+#include "terminal.h"
+#include "klog.h"
 
 /*
  * Sets the interrupt frequency of the PIT.
@@ -40,6 +42,9 @@ pit_set_frequency(uint32_t freq)
 static void
 pit_handle_irq(void)
 {
+    klog_tick();
+    terminal_tick();
+    process_tick(idt_irq_from_user());
     process_switch();
 }
 
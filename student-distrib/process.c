@@ -6,13 +6,61 @@
 #include "terminal.h"
 #include "x86_desc.h"
 #include "rtc.h"
-
-/* The virtual address that the process should be copied to */
+#include "vbe.h"
+#include "pit.h"
+#include "shlib.h"
+#include "elf.h"
+#include "i8259.h"
+#include "ps2.h"
+#include "serial.h"
+
+/* The lowest virtual address that programs may be loaded at */
 #define PROCESS_VADDR (USER_PAGE_START + 0x48000)
 
+/* The headers of an executable, as checked by process_check_exe */
+typedef struct {
+    elf_header_t hdr;
+    elf_prog_header_t phdrs[EXE_MAX_PHDRS];
+} exe_info_t;
+
+/* A range of I/O ports, inclusive */
+typedef struct {
+    uint16_t first;
+    uint16_t last;
+} port_range_t;
+
+/*
+ * Ports that ioperm() won't give to userspace: those of every
+ * device the kernel drives. Programs can move and hide the VGA
+ * cursor with escape sequences instead.
+ */
+static const port_range_t reserved_ports[] = {
+    {MASTER_8259_PORT_CMD, MASTER_8259_PORT_DATA},
+    {SLAVE_8259_PORT_CMD, SLAVE_8259_PORT_DATA},
+    {PIT_PORT_DATA_0, PIT_PORT_CMD},
+    {PS2_PORT_DATA, PS2_PORT_DATA},
+    {PS2_PORT_CMD, PS2_PORT_CMD},
+    {RTC_PORT_INDEX, RTC_PORT_DATA},
+    {VBE_PORT_INDEX, VBE_PORT_DATA},
+    {VGA_PORT_FIRST, VGA_PORT_LAST},
+    {SERIAL_PORT_BASE, SERIAL_PORT_BASE + 7},
+};
+
 /* Process control blocks */
 static pcb_t process_info[MAX_PROCESSES];
 
+/* Number of process slots that have physical memory behind them */
+static int32_t max_processes = MAX_PROCESSES;
+
+/* Scheduler ticks since boot */
+static volatile uint32_t clock_ticks = 0;
+
+/* Whether the first shell has been started */
+static bool shells_started = false;
+
+/* Terminals waiting for the scheduler to start a shell, one bit each */
+static volatile uint32_t pending_shells = 0;
+
 /* Kernel stack + pointer to PCB, one for each process */
 __attribute__((aligned(PROCESS_DATA_SIZE)))
 static process_data_t process_data[MAX_PROCESSES];
@@ -112,7 +160,7 @@ process_new_pcb(void)
     int32_t i;
 
     /* Look for an empty process slot we can fill */
-    for (i = 0; i < MAX_PROCESSES; ++i) {
+    for (i = 0; i < max_processes; ++i) {
         if (process_info[i].pid < 0) {
             process_info[i].pid = i;
             return &process_info[i];
@@ -123,13 +171,94 @@ process_new_pcb(void)
     return NULL;
 }
 
+/*
+ * Reads and checks the ELF headers of an executable. Each PT_LOAD
+ * segment must lie within the file and within the part of the
+ * user page that programs are loaded into, and the entry point
+ * must be in an executable segment. Returns false if the file
+ * is malformed.
+ */
+static bool
+process_check_exe(uint32_t inode_idx, exe_info_t *exe)
+{
+    elf_header_t *hdr = &exe->hdr;
+    if (read_data(inode_idx, 0, (uint8_t *)hdr, sizeof(*hdr)) != sizeof(*hdr)) {
+        debugf("Could not read ELF header\n");
+        return false;
+    }
+
+    /* Ensure it's an executable file */
+    if (hdr->magic != ELF_MAGIC) {
+        debugf("Magic mismatch - not an executable (got 0x%#x)\n", hdr->magic);
+        return false;
+    }
+
+    if (hdr->class != ELF_CLASS_32 ||
+        hdr->data != ELF_DATA_LSB ||
+        hdr->version != ELF_VERSION ||
+        hdr->type != ELF_TYPE_EXEC ||
+        hdr->machine != ELF_MACHINE_386 ||
+        hdr->phentsize != sizeof(elf_prog_header_t) ||
+        hdr->phnum == 0 ||
+        hdr->phnum > EXE_MAX_PHDRS) {
+        debugf("Unsupported ELF header\n");
+        return false;
+    }
+
+    int32_t phdrs_size = hdr->phnum * sizeof(elf_prog_header_t);
+    if (read_data(inode_idx, hdr->phoff, (uint8_t *)exe->phdrs, phdrs_size) != phdrs_size) {
+        debugf("Could not read program headers\n");
+        return false;
+    }
+
+    bool entry_ok = false;
+    int32_t i;
+    for (i = 0; i < hdr->phnum; ++i) {
+        elf_prog_header_t *phdr = &exe->phdrs[i];
+        if (phdr->type != ELF_PT_LOAD) {
+            continue;
+        }
+
+        uint32_t end = phdr->vaddr + phdr->memsz;
+        if (phdr->filesz > phdr->memsz ||
+            end < phdr->vaddr ||
+            phdr->vaddr < PROCESS_VADDR ||
+            end > USER_PAGE_END) {
+            debugf("Segment at 0x%#x is out of range\n", phdr->vaddr);
+            return false;
+        }
+
+        /* read_data() fails if asked to start past the end of the file */
+        uint32_t file_end = phdr->offset + phdr->filesz;
+        if (file_end < phdr->offset || read_data(inode_idx, file_end, NULL, 0) != 0) {
+            debugf("Segment at 0x%#x is past the end of the file\n", phdr->vaddr);
+            return false;
+        }
+
+        if ((phdr->flags & ELF_PF_X) &&
+            hdr->entry >= phdr->vaddr &&
+            hdr->entry < phdr->vaddr + phdr->filesz) {
+            entry_ok = true;
+        }
+    }
+
+    if (!entry_ok) {
+        debugf("Entry point 0x%#x is not in a code segment\n", hdr->entry);
+        return false;
+    }
+
+    return true;
+}
+
 /*
  * Ensures that the given file is a valid executable file.
  * On success, writes the inode index of the file to out_inode_idx,
- * the arguments to out_args, and returns 0. Otherwise, returns -1.
+ * the arguments to out_args, its headers to out_exe, and returns 0.
+ * Otherwise, returns -1.
  */
 static int32_t
-process_parse_cmd(const uint8_t *command, uint32_t *out_inode_idx, uint8_t *out_args)
+process_parse_cmd(const uint8_t *command, uint32_t *out_inode_idx,
+                  uint8_t *out_args, exe_info_t *out_exe)
 {
     /*
      * Scan for the end of the exe filename
@@ -210,16 +339,12 @@ process_parse_cmd(const uint8_t *command, uint32_t *out_inode_idx, uint8_t *out_
         return -1;
     }
 
-    /* Read the magic bytes from the file */
-    uint32_t magic = 0xffffaaaa;
-    if (read_data(dentry.inode_idx, 0, (uint8_t *)&magic, 4) != 4) {
-        debugf("Could not read magic\n");
-        return -1;
-    }
-
-    /* Ensure it's an executable file */
-    if (magic != EXE_MAGIC) {
-        debugf("Magic mismatch - not an executable (got 0x%#x)\n", magic);
+    /*
+     * Check the headers now, so nothing needs undoing if they're
+     * bad. This also rejects the shared library, which has no
+     * entry point.
+     */
+    if (!process_check_exe(dentry.inode_idx, out_exe)) {
         return -1;
     }
 
@@ -230,35 +355,52 @@ process_parse_cmd(const uint8_t *command, uint32_t *out_inode_idx, uint8_t *out_
 }
 
 /*
- * Copies the program into memory. Returns the address of
+ * Loads the program's segments into memory, and makes the pages
+ * of its read-only segments read-only. Returns the address of
  * the entry point of the program.
  *
  * You must point the process page to the correct physical
  * page before calling this!
  */
 static uint32_t
-process_load_exe(uint32_t inode_idx)
+process_load_exe(int32_t pid, uint32_t inode_idx, const exe_info_t *exe)
 {
-    uint32_t count;
-    uint32_t offset = 0;
-    do {
-        /*
-         * Copy the program to the process page.
-         * The chunk size (4096B) is arbitrary.
-         */
-        count = read_data(inode_idx, offset, (uint8_t *)PROCESS_VADDR + offset, 4096);
-        offset += count;
-    } while (count > 0);
+    /*
+     * Clear out whatever the last program in this slot left
+     * behind. After this the whole page is zero, so the BSS
+     * (memsz past filesz) of each segment is already in place.
+     */
+    paging_clear_process_page(pid);
+
+    /* Give the process its own copy of the shared library's data */
+    shlib_load_data();
+
+    int32_t i;
+    for (i = 0; i < exe->hdr.phnum; ++i) {
+        const elf_prog_header_t *phdr = &exe->phdrs[i];
+        if (phdr->type == ELF_PT_LOAD) {
+            read_data(inode_idx, phdr->offset, (uint8_t *)phdr->vaddr, phdr->filesz);
+        }
+    }
 
-    /* Clear user page contents for security */
-    uint32_t head_size = PROCESS_VADDR - USER_PAGE_START;
-    uint32_t tail_size = USER_PAGE_END - PROCESS_VADDR - offset;
-    memset((uint8_t *)USER_PAGE_START, 0, head_size);
-    memset((uint8_t *)PROCESS_VADDR + offset, 0, tail_size);
+    /*
+     * Protect the read-only segments, then unprotect the writable
+     * ones, in case they share a page.
+     */
+    for (i = 0; i < exe->hdr.phnum; ++i) {
+        const elf_prog_header_t *phdr = &exe->phdrs[i];
+        if (phdr->type == ELF_PT_LOAD && phdr->memsz > 0 && !(phdr->flags & ELF_PF_W)) {
+            paging_set_process_writable(pid, phdr->vaddr, phdr->vaddr + phdr->memsz, false);
+        }
+    }
+    for (i = 0; i < exe->hdr.phnum; ++i) {
+        const elf_prog_header_t *phdr = &exe->phdrs[i];
+        if (phdr->type == ELF_PT_LOAD && phdr->memsz > 0 && (phdr->flags & ELF_PF_W)) {
+            paging_set_process_writable(pid, phdr->vaddr, phdr->vaddr + phdr->memsz, true);
+        }
+    }
 
-    /* The entry point is located at bytes 24-27 of the executable */
-    uint32_t entry_point = *(uint32_t *)(PROCESS_VADDR + 24);
-    return entry_point;
+    return exe->hdr.entry;
 }
 
 /*
@@ -299,6 +441,12 @@ process_set_context(pcb_t *to)
 
     /* Restore TSS entry */
     tss.esp0 = get_kernel_base_esp(to);
+
+    /* Restore TLS segment; GS picks it up when we return to userspace */
+    SET_TLS_BASE(tls_desc_ptr, to->tls_base);
+
+    /* Restore I/O port permissions */
+    memcpy(tss.io_bitmap, to->io_bitmap, IO_BITMAP_SIZE);
 }
 
 /*
@@ -344,6 +492,7 @@ process_run_impl(pcb_t *pcb)
                  "movw %%ax, %%ds;"
                  "movw %%ax, %%es;"
                  "movw %%ax, %%fs;"
+                 "movw %4, %%ax;"
                  "movw %%ax, %%gs;"
 
                  /* SS register */
@@ -381,7 +530,8 @@ process_run_impl(pcb_t *pcb)
                  : "r"(pcb->entry_point),
                    "i"(USER_DS),
                    "i"(USER_PAGE_END),
-                   "i"(USER_CS)
+                   "i"(USER_CS),
+                   "i"(USER_TLS)
                  : "eax", "cc");
 
     /* Can't touch this */
@@ -424,9 +574,10 @@ process_create_child(const uint8_t *command, pcb_t *parent_pcb, int32_t terminal
 {
     uint32_t inode;
     uint8_t args[MAX_ARGS_LEN];
+    exe_info_t exe;
 
     /* First make sure we have a valid executable... */
-    if (process_parse_cmd(command, &inode, args) != 0) {
+    if (process_parse_cmd(command, &inode, args, &exe) != 0) {
         debugf("Invalid command/executable file\n");
         return NULL;
     }
@@ -454,6 +605,10 @@ process_create_child(const uint8_t *command, pcb_t *parent_pcb, int32_t terminal
     child_pcb->status = PROCESS_SCHED;
     child_pcb->vidmap = false;
     child_pcb->last_alarm = rtc_get_counter();
+    child_pcb->cpu_ticks = 0;
+    child_pcb->child_cpu_ticks = 0;
+    child_pcb->tls_base = 0;
+    memset(child_pcb->io_bitmap, 0xFF, IO_BITMAP_SIZE);
     signal_init(child_pcb->signals);
     file_init(child_pcb->files);
     strncpy((int8_t *)child_pcb->args, (const int8_t *)args, MAX_ARGS_LEN);
@@ -463,7 +618,7 @@ process_create_child(const uint8_t *command, pcb_t *parent_pcb, int32_t terminal
 
     /* Copy our program into physical memory */
     paging_update_process_page(child_pcb->pid);
-    child_pcb->entry_point = process_load_exe(inode);
+    child_pcb->entry_point = process_load_exe(child_pcb->pid, inode, &exe);
 
     return child_pcb;
 }
@@ -539,6 +694,9 @@ process_halt_impl(uint32_t status)
     /* Clear terminal input buffers */
     terminal_clear_input(child_pcb->terminal);
 
+    /* Give up the display if we were using graphics */
+    vbe_release(child_pcb->pid);
+
     /* Mark child PCB as free */
     child_pcb->pid = -1;
 
@@ -550,6 +708,9 @@ process_halt_impl(uint32_t status)
         ASSERT(0);
     }
 
+    /* Hand our CPU time down to the parent */
+    parent_pcb->child_cpu_ticks += child_pcb->cpu_ticks + child_pcb->child_cpu_ticks;
+
     /* Mark parent as runnable again */
     parent_pcb->status = PROCESS_RUN;
 
@@ -579,6 +740,77 @@ process_halt_impl(uint32_t status)
     return -1;
 }
 
+/*
+ * Counts a scheduler tick. If the tick interrupted userspace, it
+ * is charged to the executing process. Ticks that arrive while
+ * the kernel is busy are delivered on the way back to userspace,
+ * so they're charged too; the rest found the CPU idle.
+ */
+void
+process_tick(bool user)
+{
+    clock_ticks++;
+    if (user) {
+        get_executing_pcb()->cpu_ticks++;
+    }
+}
+
+/*
+ * Creates the shells asked for by process_start_terminal. They
+ * are left for the scheduler to run like any other new process.
+ * Loading a shell reads its executable and clears its process
+ * page, so this is only called in process context: on the way
+ * back to userspace, or while a syscall is waiting (see
+ * process_idle), never from an interrupt handler.
+ */
+void
+process_start_pending_shells(void)
+{
+    if (pending_shells == 0) {
+        return;
+    }
+
+    pcb_t *curr_pcb = get_executing_pcb();
+    int32_t terminal;
+    for (terminal = 0; pending_shells != 0; ++terminal) {
+        uint32_t bit = 1 << terminal;
+        if ((pending_shells & bit) == 0) {
+            continue;
+        }
+        pending_shells &= ~bit;
+
+        if (get_pcb_by_terminal(terminal) == NULL &&
+            process_create_child((uint8_t *)"shell", NULL, terminal) == NULL) {
+            debugf("Could not start shell in terminal %d\n", terminal);
+        }
+    }
+
+    /* Loading a shell switched the process page, so switch back */
+    paging_update_process_page(curr_pcb->pid);
+}
+
+/*
+ * Sleeps until the next interrupt. Syscalls that block call
+ * this in a loop until whatever they're waiting for happens.
+ * If every process is blocked, this is the only place the
+ * kernel runs outside of interrupt handlers, so it also
+ * starts any shells that were asked for in the meantime.
+ */
+void
+process_idle(void)
+{
+    /*
+     * There's no race condition between sti and hlt here,
+     * since sti will only take effect after the following
+     * instruction (hlt) has been executed.
+     */
+    sti();
+    hlt();
+    cli();
+
+    process_start_pending_shells();
+}
+
 /*
  * Switches execution to the next scheduled process.
  */
@@ -681,9 +913,13 @@ process_getargs(uint8_t *buf, int32_t nbytes)
     return 0;
 }
 
-/* vidmap() syscall handler */
-__cdecl int32_t
-process_vidmap(uint8_t **screen_start)
+/*
+ * Maps the terminal's video memory into the process, and
+ * writes the address to screen_start. If buffered is true,
+ * the mapping is double-buffered (see terminal_vidmap_buffered).
+ */
+static int32_t
+process_vidmap_impl(uint8_t **screen_start, bool buffered)
 {
     /* Ensure buffer is valid */
     if (!is_user_writable(screen_start, sizeof(uint8_t *))) {
@@ -694,6 +930,9 @@ process_vidmap(uint8_t **screen_start)
 
     /* Update vidmap status */
     terminal_update_vidmap(pcb->terminal, true);
+    if (buffered) {
+        terminal_vidmap_buffered(pcb->terminal);
+    }
 
     /* Save vidmap state in PCB */
     pcb->vidmap = true;
@@ -704,6 +943,103 @@ process_vidmap(uint8_t **screen_start)
     return 0;
 }
 
+/* vidmap() syscall handler */
+__cdecl int32_t
+process_vidmap(uint8_t **screen_start)
+{
+    return process_vidmap_impl(screen_start, false);
+}
+
+/* vidmap_buffered() syscall handler */
+__cdecl int32_t
+process_vidmap_buffered(uint8_t **screen_start)
+{
+    return process_vidmap_impl(screen_start, true);
+}
+
+/* present() syscall handler */
+__cdecl int32_t
+process_present(void)
+{
+    pcb_t *pcb = get_executing_pcb();
+    if (!pcb->vidmap) {
+        return -1;
+    }
+
+    return terminal_vidmap_present(pcb->terminal);
+}
+
+/* times() syscall handler */
+__cdecl int32_t
+process_times(process_times_t *buf)
+{
+    pcb_t *pcb = get_executing_pcb();
+    process_times_t times;
+    times.elapsed = clock_ticks;
+    times.cpu = pcb->cpu_ticks;
+    times.child_cpu = pcb->child_cpu_ticks;
+    times.ticks_per_sec = PIT_FREQ_SCHEDULER;
+
+    if (!copy_to_user(buf, &times, sizeof(times))) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * set_tls() syscall handler. Sets the base of the executing
+ * process's GS segment, so that %gs:0 addresses base. The
+ * base isn't checked; paging still decides what GS can reach.
+ */
+__cdecl int32_t
+process_set_tls(uint32_t base, __unused uint32_t unused1, __unused uint32_t unused2, int_regs_t *regs)
+{
+    pcb_t *pcb = get_executing_pcb();
+    pcb->tls_base = base;
+    SET_TLS_BASE(tls_desc_ptr, base);
+
+    /* Reloaded from the GDT on the way back to userspace */
+    regs->gs = USER_TLS;
+    return 0;
+}
+
+/*
+ * ioperm() syscall handler. Gives the executing process direct
+ * access to ports from through from + num - 1 if turn_on is
+ * nonzero, or takes it away otherwise. Ports of devices the
+ * kernel drives are never given out.
+ */
+__cdecl int32_t
+process_ioperm(uint32_t from, uint32_t num, int32_t turn_on)
+{
+    if (num == 0 || from >= IO_BITMAP_PORTS || num > IO_BITMAP_PORTS - from) {
+        return -1;
+    }
+
+    if (turn_on) {
+        int32_t i;
+        for (i = 0; i < sizeof(reserved_ports) / sizeof(reserved_ports[0]); ++i) {
+            if (from <= reserved_ports[i].last && from + num > reserved_ports[i].first) {
+                return -1;
+            }
+        }
+    }
+
+    pcb_t *pcb = get_executing_pcb();
+    uint32_t port;
+    for (port = from; port < from + num; ++port) {
+        if (turn_on) {
+            pcb->io_bitmap[port / 8] &= ~(1 << (port % 8));
+        } else {
+            pcb->io_bitmap[port / 8] |= (1 << (port % 8));
+        }
+    }
+
+    memcpy(tss.io_bitmap, pcb->io_bitmap, IO_BITMAP_SIZE);
+    return 0;
+}
+
 /* Initializes all process control related data */
 void
 process_init(void)
@@ -714,17 +1050,67 @@ process_init(void)
     }
 }
 
-/* She spawns C shells by the seashore */
+/*
+ * Limits the number of processes to the 4MB blocks that fit in
+ * physical memory, given the amount of memory above 1MB in KB
+ * (mem_upper from the boot loader). Must be called before any
+ * process is created.
+ */
 void
-process_start_shell(void)
+process_set_memory(uint32_t mem_upper)
 {
-    int32_t i;
-    for (i = 1; i < NUM_TERMINALS; ++i) {
-        process_create_child((uint8_t *)"shell", NULL, i);
+    /* Count in KB, since memory can go right up to 4GB */
+    uint32_t mem_end = KB(1) + mem_upper;
+    uint32_t start = PROCESS_PHYS_START / KB(1);
+    int32_t count = 0;
+    if (mem_end > start) {
+        count = (mem_end - start) / (PROCESS_PHYS_SIZE / KB(1));
     }
+
+    if (count < MAX_PROCESSES) {
+        max_processes = count;
+    }
+}
+
+/* Returns how many processes can exist at once */
+int32_t
+process_get_max(void)
+{
+    return max_processes;
+}
+
+/*
+ * She spawns C shells by the seashore. Only the first terminal
+ * gets a shell at boot; the others get one when they are first
+ * used (see process_start_terminal).
+ */
+void
+process_start_shell(void)
+{
+    ASSERT(get_num_terminals() <= max_processes);
+    shells_started = true;
     process_execute_impl((uint8_t *)"shell", NULL, 0);
 }
 
+/*
+ * Asks for a shell in the specified terminal if nothing is running
+ * there yet. This is called when a terminal is first displayed
+ * or receives input, so that booting doesn't have to load a shell
+ * for every terminal up front. Since that happens in keyboard and
+ * serial interrupt handlers, this only marks the terminal; the
+ * shell is loaded later in process context (see
+ * process_start_pending_shells).
+ */
+void
+process_start_terminal(int32_t terminal)
+{
+    if (!shells_started || get_pcb_by_terminal(terminal) != NULL) {
+        return;
+    }
+
+    pending_shells |= (1 << terminal);
+}
+
 /*
  * Handles RTC updates by sending an alarm signal
  * to each process every 10 seconds since its creation.
@@ -6,15 +6,20 @@
 #include "syscall.h"
 #include "idt.h"
 #include "signal.h"
+#include "x86_desc.h"
 
 /* Maximum argument length, including the NUL terminator */
 #define MAX_ARGS_LEN 1024
 
-/* Maximum number of processes */
-#define MAX_PROCESSES 6
+/*
+ * Maximum number of processes. There must be at least one per
+ * terminal, and each one takes 4MB of physical memory above 8MB,
+ * so machines with less than 72MB get fewer (see process_set_memory).
+ */
+#define MAX_PROCESSES 16
 
-/* Executable magic bytes ('\x7fELF') */
-#define EXE_MAGIC 0x464c457f
+/* Maximum number of program headers in an executable */
+#define EXE_MAX_PHDRS 8
 
 /* Process data block size, MUST BE A POWER OF 2! */
 #define PROCESS_DATA_SIZE 8192
@@ -109,6 +114,25 @@ typedef struct {
      */
     uint32_t last_alarm;
 
+    /*
+     * Number of scheduler ticks that found this process running
+     * in userspace, and the total for its halted descendants.
+     */
+    uint32_t cpu_ticks;
+    uint32_t child_cpu_ticks;
+
+    /*
+     * Base address of the process's GS segment, set by the
+     * set_tls syscall. Zero until then.
+     */
+    uint32_t tls_base;
+
+    /*
+     * I/O permission bitmap, copied into the TSS whenever this
+     * process runs. A set bit denies access to the port.
+     */
+    uint8_t io_bitmap[IO_BITMAP_SIZE];
+
     /*
      * Signal handler and status array.
      */
@@ -126,6 +150,14 @@ typedef struct {
     uint8_t args[MAX_ARGS_LEN];
 } pcb_t;
 
+/* Times reported by the times() syscall, in scheduler ticks */
+typedef struct {
+    uint32_t elapsed;
+    uint32_t cpu;
+    uint32_t child_cpu;
+    uint32_t ticks_per_sec;
+} process_times_t;
+
 /* Kernel stack struct */
 typedef struct {
     pcb_t *pcb;
@@ -146,10 +178,24 @@ __cdecl int32_t process_halt(uint32_t status);
 __cdecl int32_t process_execute(const uint8_t *command);
 __cdecl int32_t process_getargs(uint8_t *buf, int32_t nbytes);
 __cdecl int32_t process_vidmap(uint8_t **screen_start);
+__cdecl int32_t process_vidmap_buffered(uint8_t **screen_start);
+__cdecl int32_t process_present(void);
+__cdecl int32_t process_times(process_times_t *buf);
+__cdecl int32_t process_set_tls(uint32_t base, uint32_t unused1, uint32_t unused2, int_regs_t *regs);
+__cdecl int32_t process_ioperm(uint32_t from, uint32_t num, int32_t turn_on);
 
 /* Initializes processes. */
 void process_init(void);
 
+/* Limits the number of processes to what fits in memory */
+void process_set_memory(uint32_t mem_upper);
+
+/* Returns how many processes can exist at once */
+int32_t process_get_max(void);
+
+/* Counts a scheduler tick, charging it to the executing process if user is true */
+void process_tick(bool user);
+
 /* Switches to the next scheduled process */
 void process_switch(void);
 
@@ -159,6 +205,15 @@ int32_t process_halt_impl(uint32_t status);
 /* Starts the shell. This must only be called after all kernel init has completed. */
 void process_start_shell(void);
 
+/* Starts a shell in the terminal if it doesn't have one yet */
+void process_start_terminal(int32_t terminal);
+
+/* Loads the shells asked for by process_start_terminal; process context only */
+void process_start_pending_shells(void);
+
+/* Sleeps until the next interrupt, for syscalls that block */
+void process_idle(void);
+
 /* Handles RTC updates and delivers SIG_ALARM when necessary */
 void process_update_clock(uint32_t rtc_counter);
 
@@ -165,9 +165,7 @@ rtc_read(file_obj_t *file, void *buf, int32_t nbytes)
         }
 
         /* Sleep and wait for a new interrupt */
-        sti();
-        hlt();
-        cli();
+        process_idle();
     }
 
     /* Return -1 if we aborted because of a signal */
@@ -0,0 +1,145 @@
+#include "serial.h"
+#include "lib.h"
+#include "debug.h"
+#include "irq.h"
+#include "terminal.h"
+
+/* Loopback test byte and modem control bit used to detect the UART */
+#define SERIAL_MCR_LOOP  (1 << 4)
+#define SERIAL_TEST_BYTE 0xAE
+
+/*
+ * Transmit ring buffer. The head and tail indices count up
+ * forever and are masked when indexing, so head - tail is
+ * always the number of bytes waiting to be sent.
+ */
+static uint8_t tx_buf[SERIAL_TX_BUF_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+
+/* Whether a working UART was found */
+static bool present = false;
+
+/*
+ * Moves as many bytes as will fit from the ring buffer into the
+ * UART's transmit FIFO. This never waits: if the FIFO isn't empty
+ * yet, we'll be called again from the interrupt once it is. Then
+ * enables the transmit interrupt iff there is still data left.
+ */
+static void
+serial_fill_fifo(void)
+{
+    if (inb(SERIAL_PORT_LSR) & SERIAL_LSR_THRE) {
+        int32_t i;
+        for (i = 0; i < SERIAL_FIFO_SIZE && tx_tail != tx_head; ++i) {
+            outb(tx_buf[tx_tail++ & (SERIAL_TX_BUF_SIZE - 1)], SERIAL_PORT_DATA);
+        }
+    }
+
+    uint8_t ier = SERIAL_IER_RX;
+    if (tx_tail != tx_head) {
+        ier |= SERIAL_IER_TX;
+    }
+    outb(ier, SERIAL_PORT_IER);
+}
+
+/* Serial IRQ handler callback */
+static void
+serial_handle_irq(void)
+{
+    uint8_t iir;
+    while (!((iir = inb(SERIAL_PORT_IIR)) & SERIAL_IIR_NONE)) {
+        switch (iir & SERIAL_IIR_ID) {
+        case SERIAL_IIR_RX:
+        case SERIAL_IIR_TIMEOUT:
+            /* Deliver everything in the receive FIFO */
+            while (inb(SERIAL_PORT_LSR) & SERIAL_LSR_DR) {
+                terminal_handle_serial_input(inb(SERIAL_PORT_DATA));
+            }
+            break;
+        case SERIAL_IIR_TX:
+            serial_fill_fifo();
+            break;
+        case SERIAL_IIR_LINE:
+            inb(SERIAL_PORT_LSR);
+            break;
+        case SERIAL_IIR_MODEM:
+            inb(SERIAL_PORT_MSR);
+            break;
+        }
+    }
+}
+
+/*
+ * Queues bytes for transmission over the serial port. This
+ * never blocks; if the ring buffer fills up, the remaining
+ * bytes are dropped. Returns the number of bytes queued, or
+ * -1 if there is no serial port.
+ */
+int32_t
+serial_write(const uint8_t *buf, int32_t nbytes)
+{
+    if (!present) {
+        return -1;
+    }
+
+    uint32_t flags;
+    cli_and_save(flags);
+
+    int32_t space = SERIAL_TX_BUF_SIZE - (tx_head - tx_tail);
+    if (nbytes > space) {
+        nbytes = space;
+    }
+
+    int32_t i;
+    for (i = 0; i < nbytes; ++i) {
+        tx_buf[tx_head++ & (SERIAL_TX_BUF_SIZE - 1)] = buf[i];
+    }
+
+    /* Start transmitting if the UART is idle */
+    serial_fill_fifo();
+
+    restore_flags(flags);
+    return nbytes;
+}
+
+/* Returns whether the serial port was detected */
+bool
+serial_present(void)
+{
+    return present;
+}
+
+/* Initializes COM1 and enables its interrupts */
+void
+serial_init(void)
+{
+    /* Disable interrupts while we configure things */
+    outb(0, SERIAL_PORT_IER);
+
+    /* Set the baud rate divisor */
+    uint16_t divisor = SERIAL_CLOCK / SERIAL_BAUD;
+    outb(SERIAL_LCR_DLAB, SERIAL_PORT_LCR);
+    outb((divisor >> 0) & 0xff, SERIAL_PORT_DATA);
+    outb((divisor >> 8) & 0xff, SERIAL_PORT_IER);
+    outb(SERIAL_LCR_8N1, SERIAL_PORT_LCR);
+
+    /* Enable and clear the FIFOs */
+    outb(SERIAL_FCR_INIT, SERIAL_PORT_FCR);
+
+    /* Make sure there's actually a UART there with a loopback test */
+    outb(SERIAL_MCR_LOOP | SERIAL_MCR_RTS, SERIAL_PORT_MCR);
+    outb(SERIAL_TEST_BYTE, SERIAL_PORT_DATA);
+    if (inb(SERIAL_PORT_DATA) != SERIAL_TEST_BYTE) {
+        debugf("No serial port found\n");
+        return;
+    }
+
+    /* Back to normal operation, with interrupts routed to the PIC */
+    outb(SERIAL_MCR_DTR | SERIAL_MCR_RTS | SERIAL_MCR_OUT2, SERIAL_PORT_MCR);
+    present = true;
+
+    /* Register serial IRQ handler and enable receive interrupts */
+    irq_register_handler(IRQ_SERIAL, serial_handle_irq);
+    outb(SERIAL_IER_RX, SERIAL_PORT_IER);
+}
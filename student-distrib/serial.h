@@ -0,0 +1,69 @@
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "types.h"
+
+/* COM1 I/O ports (offsets from the base port) */
+#define SERIAL_PORT_BASE 0x3F8
+#define SERIAL_PORT_DATA (SERIAL_PORT_BASE + 0) /* RBR/THR, or DLL if DLAB */
+#define SERIAL_PORT_IER  (SERIAL_PORT_BASE + 1) /* Interrupt enable, or DLM if DLAB */
+#define SERIAL_PORT_IIR  (SERIAL_PORT_BASE + 2) /* Interrupt ID (read) */
+#define SERIAL_PORT_FCR  (SERIAL_PORT_BASE + 2) /* FIFO control (write) */
+#define SERIAL_PORT_LCR  (SERIAL_PORT_BASE + 3) /* Line control */
+#define SERIAL_PORT_MCR  (SERIAL_PORT_BASE + 4) /* Modem control */
+#define SERIAL_PORT_LSR  (SERIAL_PORT_BASE + 5) /* Line status */
+#define SERIAL_PORT_MSR  (SERIAL_PORT_BASE + 6) /* Modem status */
+
+/* Interrupt enable register bits */
+#define SERIAL_IER_RX   (1 << 0) /* Received data available */
+#define SERIAL_IER_TX   (1 << 1) /* Transmit holding register empty */
+
+/* Interrupt identification register values */
+#define SERIAL_IIR_NONE    0x01 /* No interrupt pending */
+#define SERIAL_IIR_ID      0x0E /* Mask for the interrupt ID */
+#define SERIAL_IIR_MODEM   0x00 /* Modem status changed */
+#define SERIAL_IIR_TX      0x02 /* Transmit holding register empty */
+#define SERIAL_IIR_RX      0x04 /* Received data available */
+#define SERIAL_IIR_LINE    0x06 /* Line status changed */
+#define SERIAL_IIR_TIMEOUT 0x0C /* Receive FIFO timeout */
+
+/* FIFO control register value: enable, clear both, 14 byte trigger */
+#define SERIAL_FCR_INIT 0xC7
+
+/* Line control register bits */
+#define SERIAL_LCR_8N1  0x03 /* 8 data bits, no parity, 1 stop bit */
+#define SERIAL_LCR_DLAB 0x80 /* Divisor latch access */
+
+/* Modem control register bits */
+#define SERIAL_MCR_DTR  (1 << 0)
+#define SERIAL_MCR_RTS  (1 << 1)
+#define SERIAL_MCR_OUT2 (1 << 3) /* Must be set to get interrupts */
+
+/* Line status register bits */
+#define SERIAL_LSR_DR   (1 << 0) /* Data ready */
+#define SERIAL_LSR_THRE (1 << 5) /* Transmit holding register empty */
+
+/* UART clock rate, and the divisor for the rate we use (115200 baud) */
+#define SERIAL_CLOCK 115200
+#define SERIAL_BAUD  115200
+
+/* Size of the transmit FIFO on a 16550 */
+#define SERIAL_FIFO_SIZE 16
+
+/* Size of the transmit ring buffer (must be a power of 2) */
+#define SERIAL_TX_BUF_SIZE 8192
+
+#ifndef ASM
+
+/* Queues bytes for transmission over the serial port */
+int32_t serial_write(const uint8_t *buf, int32_t nbytes);
+
+/* Returns whether the serial port was detected */
+bool serial_present(void);
+
+/* Initializes the serial port */
+void serial_init(void);
+
+#endif /* ASM */
+
+#endif /* _SERIAL_H */
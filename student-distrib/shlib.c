@@ -0,0 +1,146 @@
+#include "shlib.h"
+#include "elf.h"
+#include "filesys.h"
+#include "paging.h"
+#include "lib.h"
+#include "debug.h"
+#include "klog.h"
+
+#define ALIGN_4KB __attribute__((aligned(KB(4))))
+
+/*
+ * Library code. This is loaded once at boot and mapped read-only
+ * into every process, so programs linked against the library
+ * don't carry (or load) their own copies of it.
+ */
+static ALIGN_4KB uint8_t shlib_text[SHLIB_PAGE_END - SHLIB_PAGE_START];
+
+/*
+ * Initialized library data, copied into each process's page on
+ * exec. The library's BSS follows it, and is zeroed along with
+ * the rest of the page.
+ */
+static uint8_t shlib_data[SHLIB_MAX_INIT_DATA];
+static uint32_t shlib_data_len = 0;
+
+/*
+ * Loads a PT_LOAD segment of the library. Code must lie in the
+ * shared pages and must not be writable; data must lie in the
+ * per-process data area. Advances *text_end past the code.
+ * Returns false if the segment is invalid.
+ */
+static bool
+shlib_load_segment(uint32_t inode_idx, const elf_prog_header_t *phdr, uint32_t *text_end)
+{
+    uint32_t start = phdr->vaddr;
+    uint32_t end = start + phdr->memsz;
+    uint8_t *dest;
+
+    if (phdr->filesz > phdr->memsz || end < start) {
+        return false;
+    }
+
+    if (start >= SHLIB_PAGE_START && end <= SHLIB_PAGE_END) {
+        if (phdr->flags & ELF_PF_W) {
+            debugf("Shared library code is writable\n");
+            return false;
+        }
+        dest = &shlib_text[start - SHLIB_PAGE_START];
+        if (end - SHLIB_PAGE_START > *text_end) {
+            *text_end = end - SHLIB_PAGE_START;
+        }
+    } else if (start >= SHLIB_DATA_START && end <= SHLIB_DATA_END) {
+        uint32_t data_end = start - SHLIB_DATA_START + phdr->filesz;
+        if (data_end > SHLIB_MAX_INIT_DATA) {
+            debugf("Shared library data is too big\n");
+            return false;
+        }
+        dest = &shlib_data[start - SHLIB_DATA_START];
+        if (data_end > shlib_data_len) {
+            shlib_data_len = data_end;
+        }
+    } else {
+        debugf("Shared library segment at 0x%#x is out of range\n", start);
+        return false;
+    }
+
+    return read_data(inode_idx, phdr->offset, dest, phdr->filesz) == (int32_t)phdr->filesz;
+}
+
+/*
+ * Reads the library's ELF headers and loads its segments.
+ * Writes the size of the code to out_text_size. Returns false
+ * if the library is malformed.
+ */
+static bool
+shlib_load(uint32_t inode_idx, uint32_t *out_text_size)
+{
+    elf_header_t hdr;
+    if (read_data(inode_idx, 0, (uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr) ||
+        hdr.magic != ELF_MAGIC ||
+        hdr.class != ELF_CLASS_32 ||
+        hdr.data != ELF_DATA_LSB ||
+        hdr.type != ELF_TYPE_EXEC ||
+        hdr.machine != ELF_MACHINE_386 ||
+        hdr.phentsize != sizeof(elf_prog_header_t) ||
+        hdr.phnum > SHLIB_MAX_PHDRS) {
+        debugf("Bad shared library header\n");
+        return false;
+    }
+
+    elf_prog_header_t phdrs[SHLIB_MAX_PHDRS];
+    uint32_t phdrs_size = hdr.phnum * sizeof(elf_prog_header_t);
+    if (read_data(inode_idx, hdr.phoff, (uint8_t *)phdrs, phdrs_size) != (int32_t)phdrs_size) {
+        debugf("Could not read shared library program headers\n");
+        return false;
+    }
+
+    *out_text_size = 0;
+    int32_t i;
+    for (i = 0; i < hdr.phnum; ++i) {
+        if (phdrs[i].type == ELF_PT_LOAD &&
+            !shlib_load_segment(inode_idx, &phdrs[i], out_text_size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Loads the shared library from the filesystem and maps its code
+ * into every process. Programs that were linked against it won't
+ * run if it's missing, but static ones still will.
+ */
+void
+shlib_init(void)
+{
+    dentry_t dentry;
+    if (read_dentry_by_name((const uint8_t *)SHLIB_NAME, &dentry) != 0 ||
+        dentry.type != FTYPE_FILE) {
+        klog(KLOG_WARN, "Shared library %s not found\n", SHLIB_NAME);
+        return;
+    }
+
+    uint32_t text_size;
+    if (!shlib_load(dentry.inode_idx, &text_size)) {
+        klog(KLOG_WARN, "Shared library %s is invalid\n", SHLIB_NAME);
+        memset(shlib_text, 0, sizeof(shlib_text));
+        shlib_data_len = 0;
+        return;
+    }
+
+    paging_map_shlib(shlib_text, text_size);
+    klog(KLOG_INFO, "Loaded %s: %u bytes of code, %u bytes of data\n",
+         SHLIB_NAME, text_size, shlib_data_len);
+}
+
+/*
+ * Copies the library's initialized data into the current process
+ * page. This must be called after the page has been cleared.
+ */
+void
+shlib_load_data(void)
+{
+    memcpy((uint8_t *)SHLIB_DATA_START, shlib_data, shlib_data_len);
+}
@@ -0,0 +1,25 @@
+#ifndef _SHLIB_H
+#define _SHLIB_H
+
+#include "types.h"
+
+/* Name of the shared library in the filesystem */
+#define SHLIB_NAME "libece391"
+
+/* Maximum size of the library's initialized data */
+#define SHLIB_MAX_INIT_DATA 0x4000
+
+/* Maximum number of program headers in the library */
+#define SHLIB_MAX_PHDRS 8
+
+#ifndef ASM
+
+/* Loads the shared library and maps its code into every process */
+void shlib_init(void);
+
+/* Copies the library's initialized data into the process page */
+void shlib_load_data(void);
+
+#endif /* ASM */
+
+#endif /* _SHLIB_H */
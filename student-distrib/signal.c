@@ -80,7 +80,7 @@ signal_deliver(signal_info_t *sig, int_regs_t *regs)
     regs->ds = USER_DS;
     regs->es = USER_DS;
     regs->fs = USER_DS;
-    regs->gs = USER_DS;
+    regs->gs = USER_TLS;
     regs->ss = USER_DS;
 
     /* Clear direction flag */
@@ -142,7 +142,7 @@ signal_sigreturn(
     tmp_regs.ds = USER_DS;
     tmp_regs.es = USER_DS;
     tmp_regs.fs = USER_DS;
-    tmp_regs.gs = USER_DS;
+    tmp_regs.gs = USER_TLS;
     tmp_regs.ss = USER_DS;
 
     /* Copy temporary context to kernel context */
@@ -5,23 +5,79 @@
 #include "process.h"
 #include "paging.h"
 #include "signal.h"
+#include "pit.h"
+#include "serial.h"
+#include "vbe.h"
 
-/* Address of the global video memory page */
+/* Address of the start of VGA text memory */
 #define VGA_MEMORY ((uint8_t *)VIDEO_PAGE_START)
 
+/* Address of the VGA page used to display scrollback history */
+#define VGA_VIEW_MEMORY ((uint8_t *)VIDEO_PAGE_END - TERMINAL_VIEW_SIZE)
+
+/* Number of bytes in a row of characters */
+#define BYTES_PER_ROW (NUM_COLS << 1)
+
+/* Converts a pointer into VGA memory to a CRTC character offset */
+#define VGA_OFFSET(ptr) (((uint8_t *)(ptr) - VGA_MEMORY) >> 1)
+
+/*
+ * How many times to poll the VGA status register for a change
+ * in vertical retrace before giving up. A frame takes about
+ * 14-17ms, and each poll is at least a microsecond, so this
+ * covers several frames.
+ */
+#define VGA_RETRACE_POLLS 100000
+
+/* Attribute bit that makes the foreground color bright */
+#define ATTRIB_BRIGHT 0x08
+
+/* Maps ANSI color numbers to VGA color numbers */
+static const uint8_t ansi_colors[8] = {
+    0x0, /* Black */
+    0x4, /* Red */
+    0x2, /* Green */
+    0x6, /* Yellow (brown) */
+    0x1, /* Blue */
+    0x5, /* Magenta */
+    0x3, /* Cyan */
+    0x7, /* White (light gray) */
+};
+
+/* Number of PIT ticks between drawing pending output */
+#define TERMINAL_FRAME_TICKS (PIT_FREQ_SCHEDULER / TERMINAL_FRAME_RATE)
+
 /* Holds information about each terminal */
-static terminal_state_t terminal_states[NUM_TERMINALS];
+static terminal_state_t terminal_states[MAX_TERMINALS];
+
+/* Number of terminals in use */
+static int32_t num_terminals = DEFAULT_TERMINALS;
 
 /* Index of the currently displayed terminal */
 static int32_t display_terminal = -1;
 
+/* Number of PIT ticks since pending output was last drawn */
+static int32_t frame_ticks = 0;
+
+/* Number of frames drawn, used to pace vidmap page flips */
+static volatile uint32_t frame_count = 0;
+
+/* Whether any program has read from stdin yet */
+static bool prompt_reached = false;
+
+/*
+ * Index of the terminal bound to the serial port, or one of
+ * the TERMINAL_SERIAL_* constants
+ */
+static int32_t serial_terminal = TERMINAL_SERIAL_NONE;
+
 /*
  * Returns the specified terminal.
  */
 static terminal_state_t *
 get_terminal(int32_t index)
 {
-    ASSERT(index >= 0 && index < NUM_TERMINALS);
+    ASSERT(index >= 0 && index < num_terminals);
     return &terminal_states[index];
 }
 
@@ -48,6 +104,36 @@ get_display_terminal(void)
     return get_terminal(display_terminal);
 }
 
+/*
+ * Returns whether the specified terminal is bound to
+ * the serial port.
+ */
+static bool
+is_serial_terminal(terminal_state_t *term)
+{
+    return serial_terminal >= 0 && term == get_terminal(serial_terminal);
+}
+
+/*
+ * Sends characters to the serial port, translating line
+ * feeds into CR LF pairs for the terminal at the other end.
+ */
+static void
+terminal_serial_write(const uint8_t *buf, int32_t nbytes)
+{
+    static const uint8_t crlf[] = {'\r', '\n'};
+    int32_t start = 0;
+    int32_t i;
+    for (i = 0; i < nbytes; ++i) {
+        if (buf[i] == '\n') {
+            serial_write(&buf[start], i - start);
+            serial_write(crlf, sizeof(crlf));
+            start = i + 1;
+        }
+    }
+    serial_write(&buf[start], nbytes - start);
+}
+
 /*
  * Sets the contents of a VGA register.
  * index - the register index
@@ -60,18 +146,78 @@ vga_set_register(uint8_t index, uint8_t value)
     outb(value, VGA_PORT_DATA);
 }
 
-/* Clears out a region of VGA memory (overwrites it with spaces) */
+/*
+ * Set once a retrace wait times out, which means the retrace
+ * bit isn't working (no VGA, or another adapter owns the
+ * display). After that we don't wait for retrace at all.
+ */
+static bool vga_retrace_broken = false;
+
+/*
+ * Busy-waits until the VGA is in vertical retrace, or
+ * until it isn't, depending on in_retrace. Interrupts are
+ * let in between polls, so this doesn't hold off the PIT
+ * and keyboard for up to a frame. Gives up after
+ * VGA_RETRACE_POLLS polls; returns whether it succeeded.
+ */
+static bool
+vga_wait_retrace(bool in_retrace)
+{
+    if (vga_retrace_broken) {
+        return false;
+    }
+
+    int32_t i;
+    for (i = 0; i < VGA_RETRACE_POLLS; ++i) {
+        if (((inb(VGA_PORT_STATUS) & VGA_STATUS_RETRACE) != 0) == in_retrace) {
+            return true;
+        }
+
+        /* sti only takes effect after the next instruction */
+        sti();
+        asm volatile("nop");
+        cli();
+    }
+
+    debugf("Timed out waiting for vertical retrace\n");
+    vga_retrace_broken = true;
+    return false;
+}
+
+/*
+ * Fills a region of VGA memory with spaces that have
+ * the specified attribute byte.
+ */
 static void
-vga_clear_region(uint8_t *ptr, int32_t num_chars)
+vga_fill_region(uint8_t *ptr, uint8_t attrib, int32_t num_chars)
 {
     /*
-     * Screen clear memset pattern, same as [0] = ' ', [1] = ATTRIB
+     * Screen clear memset pattern, same as [0] = ' ', [1] = attrib
      * Why not a simple for loop? Because I can.
      */
-    int32_t pattern = (' ' << 0) | (ATTRIB << 8);
+    int32_t pattern = (' ' << 0) | (attrib << 8);
     memset_word(ptr, pattern, num_chars);
 }
 
+/*
+ * Clears out a region of VGA memory (overwrites it with spaces),
+ * using the current colors of the specified terminal.
+ */
+static void
+vga_clear_region(const terminal_state_t *term, uint8_t *ptr, int32_t num_chars)
+{
+    vga_fill_region(ptr, term->attrib, num_chars);
+}
+
+/*
+ * Whether the CRTC currently has the cursor turned off, so the
+ * cursor start register is only touched when that changes. -1
+ * means unknown, which forces the next update to write it; a
+ * terminal switch resets it, since graphics may have been
+ * turned on or off.
+ */
+static int32_t vga_cursor_hidden = -1;
+
 /*
  * Sets the VGA cursor position to the cursor position
  * in the specified terminal.
@@ -84,124 +230,417 @@ terminal_update_cursor(terminal_state_t *term)
         return;
     }
 
-    /* Write the position to the VGA cursor position registers */
-    uint16_t pos = term->cursor.screen_y * NUM_COLS + term->cursor.screen_x;
+    /*
+     * Write the position to the VGA cursor position registers.
+     * Note that this is relative to the start of VGA memory,
+     * not the start of the displayed screen.
+     */
+    uint16_t pos = VGA_OFFSET(term->video_mem);
+    pos += term->cursor.screen_y * NUM_COLS + term->cursor.screen_x;
     vga_set_register(VGA_REG_CURSOR_LO, (pos >> 0) & 0xff);
     vga_set_register(VGA_REG_CURSOR_HI, (pos >> 8) & 0xff);
+
+    /* Keep the cursor shape, but turn it on or off if needed */
+    if (vga_cursor_hidden != term->cursor_hidden) {
+        outb(VGA_REG_CURSOR_START, VGA_PORT_INDEX);
+        uint8_t cursor_start = inb(VGA_PORT_DATA) & ~VGA_CURSOR_DISABLE;
+        if (term->cursor_hidden) {
+            cursor_start |= VGA_CURSOR_DISABLE;
+        }
+        vga_set_register(VGA_REG_CURSOR_START, cursor_start);
+        vga_cursor_hidden = term->cursor_hidden;
+    }
 }
 
 /*
- * Swaps the VGA video memory buffers.
+ * Points the CRTC start address at the specified terminal's
+ * screen, if it is being displayed.
  */
 static void
-terminal_swap_buffer(terminal_state_t *old, terminal_state_t *new)
+terminal_update_start(terminal_state_t *term)
 {
-    /* Old terminal must have been the display terminal */
-    ASSERT(old->video_mem == VGA_MEMORY);
+    /* Ignore if this terminal isn't being displayed */
+    if (term != get_display_terminal()) {
+        return;
+    }
 
-    /*
-     * Copy the global VGA memory to the previously displayed
-     * terminal's backing buffer, then point its active video
-     * memory to the backing buffer
-     */
-    memcpy(old->backing_mem, VGA_MEMORY, VIDEO_MEM_SIZE);
-    old->video_mem = old->backing_mem;
+    /* If we're looking at the history, that's on another page */
+    uint16_t start = VGA_OFFSET(term->video_mem);
+    if (term->history.view_offset > 0) {
+        start = VGA_OFFSET(VGA_VIEW_MEMORY);
+    }
 
-    /*
-     * Copy the contents of the new terminal's backing buffer
-     * into global VGA memory, then point its active video
-     * memory to the global VGA memory
-     */
-    memcpy(VGA_MEMORY, new->backing_mem, VIDEO_MEM_SIZE);
-    new->video_mem = VGA_MEMORY;
+    vga_set_register(VGA_REG_START_LO, (start >> 0) & 0xff);
+    vga_set_register(VGA_REG_START_HI, (start >> 8) & 0xff);
+}
+
+/*
+ * Returns a pointer to the specified row of the terminal's
+ * scrollback history, counting backwards from the most recent
+ * row (back = 1). Returns NULL if the row is not in the history.
+ */
+static uint8_t *
+terminal_history_row(terminal_state_t *term, int32_t back)
+{
+    history_buf_t *hist = &term->history;
+    if (back < 1 || back > hist->count) {
+        return NULL;
+    }
+
+    int32_t index = hist->head - back;
+    if (index < 0) {
+        index += TERMINAL_HISTORY_ROWS;
+    }
+    return hist->rows[index];
+}
+
+/*
+ * Appends a row to the terminal's scrollback history,
+ * overwriting the oldest row if the history is full. If
+ * row is NULL, a blank row is appended.
+ */
+static void
+terminal_history_push(terminal_state_t *term, const uint8_t *row)
+{
+    history_buf_t *hist = &term->history;
+    uint8_t *dest = hist->rows[hist->head];
+    if (row != NULL) {
+        memcpy(dest, row, BYTES_PER_ROW);
+    } else {
+        vga_clear_region(term, dest, NUM_COLS);
+    }
+
+    if (++hist->head == TERMINAL_HISTORY_ROWS) {
+        hist->head = 0;
+    }
+    if (hist->count < TERMINAL_HISTORY_ROWS) {
+        hist->count++;
+    }
+
+    /* Keep the history view pointing at the same rows */
+    if (hist->view_offset > 0 && hist->view_offset < hist->count) {
+        hist->view_offset++;
+    }
+}
+
+/*
+ * Draws the scrollback history view for the specified terminal
+ * into the history page. The view consists of the history rows
+ * followed by the top of the live screen.
+ */
+static void
+terminal_draw_history(terminal_state_t *term)
+{
+    int32_t offset = term->history.view_offset;
+    int32_t y;
+    for (y = 0; y < NUM_ROWS; ++y) {
+        uint8_t *dest = VGA_VIEW_MEMORY + y * BYTES_PER_ROW;
+        if (y < offset) {
+            memcpy(dest, terminal_history_row(term, offset - y), BYTES_PER_ROW);
+        } else {
+            memcpy(dest, term->video_mem + (y - offset) * BYTES_PER_ROW, BYTES_PER_ROW);
+        }
+    }
 }
 
 /*
- * Scrolls the specified terminal down. This does
- * NOT decrement the cursor y position!
+ * Scrolls the history view of the specified terminal back by
+ * the specified number of rows (forward if negative). The
+ * output position of the terminal is unaffected; new output
+ * keeps going to the live screen, which is displayed again
+ * once the view is scrolled all the way forward.
  */
 static void
-terminal_scroll_down(terminal_state_t *term)
+terminal_scroll_history(terminal_state_t *term, int32_t rows)
 {
-    int32_t bytes_per_row = NUM_COLS << 1;
-    int32_t shift_count = VIDEO_MEM_SIZE - bytes_per_row;
+    history_buf_t *hist = &term->history;
+    int32_t offset = hist->view_offset + rows;
+    if (offset > hist->count) {
+        offset = hist->count;
+    } else if (offset < 0) {
+        offset = 0;
+    }
 
-    /* Shift rows forward by one row */
-    memmove(term->video_mem, term->video_mem + bytes_per_row, shift_count);
+    if (offset == hist->view_offset) {
+        return;
+    }
 
-    /* Clear out last row */
-    vga_clear_region(term->video_mem + shift_count, bytes_per_row / 2);
+    hist->view_offset = offset;
+    if (offset > 0) {
+        terminal_draw_history(term);
+    }
+    terminal_update_start(term);
 }
 
 /*
- * Writes a character at the current cursor position
- * in the specified terminal. This does NOT update
- * the cursor position!
+ * Moves the terminal screen so that it starts at the
+ * specified address, which must lie in the terminal's
+ * VGA region. Only the first keep_bytes bytes of the
+ * current screen are carried over; the rest of the new
+ * screen is cleared.
  */
 static void
-terminal_write_char(terminal_state_t *term, uint8_t c)
+terminal_move_screen(terminal_state_t *term, uint8_t *new_mem, int32_t keep_bytes)
 {
-    int32_t x = term->cursor.screen_x;
-    int32_t y = term->cursor.screen_y;
-    term->video_mem[((y * NUM_COLS + x) << 1) + 0] = c;
-    term->video_mem[((y * NUM_COLS + x) << 1) + 1] = ATTRIB;
+    ASSERT(new_mem >= term->vga_base);
+    ASSERT(new_mem + VIDEO_MEM_SIZE <= term->vga_base + TERMINAL_VGA_SIZE);
+
+    if (new_mem != term->video_mem && keep_bytes > 0) {
+        memmove(new_mem, term->video_mem, keep_bytes);
+    }
+    vga_clear_region(term, new_mem + keep_bytes, (VIDEO_MEM_SIZE - keep_bytes) / 2);
+    term->video_mem = new_mem;
+    terminal_update_start(term);
 }
 
 /*
- * Prints a character to the specified terminal.
- * This does NOT update the cursor position!
+ * Scrolls the specified terminal down by the specified
+ * number of lines. This does NOT decrement the cursor
+ * y position!
+ *
+ * Normally this just moves the screen forward inside the
+ * terminal's VGA region and bumps the CRTC start address,
+ * so no characters need to be copied. When we reach the
+ * end of the region, the rows that are still visible are
+ * copied back to the start of the region. Terminals with
+ * a vidmap page can't move, so they always copy.
  */
 static void
-terminal_putc_impl(terminal_state_t *term, uint8_t c)
+terminal_scroll_down(terminal_state_t *term, int32_t lines)
+{
+    int32_t i;
+
+    /*
+     * Rows leaving the top of the screen go into the history.
+     * If we're scrolling by more than a screen, the rows in
+     * between were never drawn; we leave blanks for them which
+     * terminal_puts_impl() fills in (and can skip any that won't
+     * fit in the history anyways).
+     */
+    for (i = 0; i < lines && i < NUM_ROWS; ++i) {
+        terminal_history_push(term, term->video_mem + i * BYTES_PER_ROW);
+    }
+    for (; i < lines && i < NUM_ROWS + TERMINAL_HISTORY_ROWS; ++i) {
+        terminal_history_push(term, NULL);
+    }
+
+    /* Scrolling past the whole screen just clears it */
+    if (lines > NUM_ROWS) {
+        lines = NUM_ROWS;
+    }
+
+    int32_t shift_bytes = lines * BYTES_PER_ROW;
+    int32_t keep_bytes = VIDEO_MEM_SIZE - shift_bytes;
+    uint8_t *region_end = term->vga_base + TERMINAL_VGA_SIZE;
+    uint8_t *new_mem = term->video_mem + shift_bytes;
+
+    /*
+     * With vidmap the screen is pinned to the start of its page
+     * (which is only ever the second page with double buffering)
+     */
+    uint8_t *home = term->vidmap ? term->video_mem : term->vga_base;
+
+    if (!term->vidmap && new_mem + VIDEO_MEM_SIZE <= region_end) {
+        /* Still room in the region, just move the start forward */
+        vga_clear_region(term, new_mem + keep_bytes, shift_bytes / 2);
+        term->video_mem = new_mem;
+        terminal_update_start(term);
+    } else {
+        /*
+         * Wrap around to the start of the region, carrying over
+         * the rows that are still visible (which now begin at
+         * new_mem)
+         */
+        term->video_mem = new_mem;
+        terminal_move_screen(term, home, keep_bytes);
+    }
+}
+
+/*
+ * Writes a character at the specified cursor position.
+ * Rows above the top of the screen have already been
+ * scrolled off, so they are written to the history
+ * instead (or dropped if they don't fit). If term is
+ * NULL, nothing is drawn. This does NOT update the
+ * cursor position!
+ */
+static void
+terminal_write_char(terminal_state_t *term, cursor_pos_t *cursor, uint8_t c)
+{
+    int32_t x = cursor->screen_x;
+    int32_t y = cursor->screen_y;
+    if (term == NULL) {
+        return;
+    }
+
+    uint8_t *row;
+    if (y >= 0) {
+        row = term->video_mem + y * BYTES_PER_ROW;
+    } else if ((row = terminal_history_row(term, -y)) == NULL) {
+        return;
+    }
+
+    row[(x << 1) + 0] = c;
+    row[(x << 1) + 1] = term->attrib;
+}
+
+/*
+ * Prints a character at the given cursor position and
+ * advances the cursor. Scrolling is left to the caller:
+ * returns true if the cursor moved below the bottom row,
+ * in which case the screen must be scrolled by one line
+ * and the cursor y position decremented.
+ */
+static bool
+terminal_putc_cursor(terminal_state_t *term, cursor_pos_t *cursor, uint8_t c)
 {
     if (c == '\n') {
         /* Reset x position, increment y position */
-        term->cursor.logical_x = 0;
-        term->cursor.screen_x = 0;
-        term->cursor.screen_y++;
-
-        /* Scroll if we're at the bottom */
-        if (term->cursor.screen_y >= NUM_ROWS) {
-            terminal_scroll_down(term);
-            term->cursor.screen_y--;
-        }
+        cursor->logical_x = 0;
+        cursor->screen_x = 0;
+        cursor->screen_y++;
     } else if (c == '\r') {
         /* Just reset x position */
-        term->cursor.logical_x = 0;
-        term->cursor.screen_x = 0;
+        cursor->logical_x = 0;
+        cursor->screen_x = 0;
     } else if (c == '\b') {
         /* Only allow when there's something on this logical line */
-        if (term->cursor.logical_x > 0) {
-            term->cursor.logical_x--;
-            term->cursor.screen_x--;
+        if (cursor->logical_x > 0) {
+            cursor->logical_x--;
+            cursor->screen_x--;
 
             /* If we're off-screen, move the cursor back up a line */
-            if (term->cursor.screen_x < 0) {
-                term->cursor.screen_y--;
-                term->cursor.screen_x += NUM_COLS;
+            if (cursor->screen_x < 0) {
+                cursor->screen_y--;
+                cursor->screen_x += NUM_COLS;
             }
 
             /* Clear the character under the cursor */
-            terminal_write_char(term, ' ');
+            terminal_write_char(term, cursor, ' ');
         }
     } else {
         /* Write the character to screen */
-        terminal_write_char(term, c);
+        terminal_write_char(term, cursor, c);
 
         /* Move the cursor rightwards, with text wrapping */
-        term->cursor.logical_x++;
-        term->cursor.screen_x++;
-        if (term->cursor.screen_x >= NUM_COLS) {
-            term->cursor.screen_y++;
-            term->cursor.screen_x -= NUM_COLS;
+        cursor->logical_x++;
+        cursor->screen_x++;
+        if (cursor->screen_x >= NUM_COLS) {
+            cursor->screen_y++;
+            cursor->screen_x -= NUM_COLS;
+        }
+    }
+
+    /* Scroll if we went past the bottom */
+    return cursor->screen_y >= NUM_ROWS;
+}
+
+/*
+ * Returns whether the scrolling region of the specified
+ * terminal covers the whole screen.
+ */
+static bool
+terminal_full_region(terminal_state_t *term)
+{
+    return term->scroll_top == 0 && term->scroll_bottom == NUM_ROWS - 1;
+}
+
+/*
+ * Scrolls the rows in the scrolling region of the specified
+ * terminal up by one line, clearing the bottom row. Only used
+ * when the region doesn't cover the whole screen; nothing
+ * goes into the history.
+ */
+static void
+terminal_scroll_region(terminal_state_t *term)
+{
+    uint8_t *top = term->video_mem + term->scroll_top * BYTES_PER_ROW;
+    uint8_t *bottom = term->video_mem + term->scroll_bottom * BYTES_PER_ROW;
+    memmove(top, top + BYTES_PER_ROW, bottom - top);
+    vga_fill_region(bottom, term->attrib, NUM_COLS);
+}
+
+/*
+ * Prints a character to the specified terminal. Escape
+ * sequences are NOT interpreted here.
+ * This does NOT update the cursor position!
+ */
+static void
+terminal_putc_impl(terminal_state_t *term, uint8_t c)
+{
+    cursor_pos_t *cursor = &term->cursor;
+
+    if (terminal_full_region(term)) {
+        if (terminal_putc_cursor(term, cursor, c)) {
+            terminal_scroll_down(term, 1);
+            cursor->screen_y--;
+        }
+        return;
+    }
+
+    /*
+     * With a partial scrolling region, only moving past the
+     * bottom of the region scrolls. Moving past the bottom
+     * of the screen outside the region just sticks to the
+     * last row.
+     */
+    bool in_region = cursor->screen_y >= term->scroll_top &&
+                     cursor->screen_y <= term->scroll_bottom;
+    terminal_putc_cursor(term, cursor, c);
+    if (in_region && cursor->screen_y > term->scroll_bottom) {
+        terminal_scroll_region(term);
+        cursor->screen_y = term->scroll_bottom;
+    } else if (cursor->screen_y >= NUM_ROWS) {
+        cursor->screen_y = NUM_ROWS - 1;
+    }
+}
+
+/*
+ * Prints a buffer of characters containing no escape sequences
+ * to the specified terminal.
+ * This is equivalent to calling terminal_putc_impl() on each
+ * character, but only scrolls the screen once: we first
+ * simulate the cursor to find out how many lines the buffer
+ * will scroll by, do that in one shot, then replay the buffer
+ * with the cursor shifted up by the same amount. Anything that
+ * lands above the top row would have been scrolled off anyways,
+ * so it goes straight into the history. The amount of video memory touched is
+ * thus bounded by the final screen, not the line count.
+ * This does NOT update the cursor position!
+ */
+static void
+terminal_puts_text(terminal_state_t *term, const uint8_t *buf, int32_t nbytes)
+{
+    int32_t i;
+
+    /* The shortcut only works if the whole screen scrolls */
+    if (!terminal_full_region(term)) {
+        for (i = 0; i < nbytes; ++i) {
+            terminal_putc_impl(term, buf[i]);
         }
+        return;
+    }
 
-        /* Scroll if we wrapped some text at the bottom */
-        if (term->cursor.screen_y >= NUM_ROWS) {
-            terminal_scroll_down(term);
-            term->cursor.screen_y--;
+    /* Count how many times we would have scrolled */
+    cursor_pos_t sim = term->cursor;
+    int32_t scroll_lines = 0;
+    for (i = 0; i < nbytes; ++i) {
+        if (terminal_putc_cursor(NULL, &sim, buf[i])) {
+            sim.screen_y--;
+            scroll_lines++;
         }
     }
+
+    /* Scroll once, and shift the cursor to match */
+    if (scroll_lines > 0) {
+        terminal_scroll_down(term, scroll_lines);
+        term->cursor.screen_y -= scroll_lines;
+    }
+
+    /* Now draw; the cursor can no longer go past the bottom */
+    for (i = 0; i < nbytes; ++i) {
+        terminal_putc_cursor(term, &term->cursor, buf[i]);
+    }
 }
 
 /*
@@ -211,8 +650,11 @@ terminal_putc_impl(terminal_state_t *term, uint8_t c)
 static void
 terminal_clear_impl(terminal_state_t *term)
 {
-    /* Clear screen */
-    vga_clear_region(term->video_mem, VIDEO_MEM_SIZE / 2);
+    /* Stop viewing the history */
+    terminal_scroll_history(term, -term->history.view_offset);
+
+    /* Clear screen, moving it back to the start of the region */
+    terminal_move_screen(term, term->vga_base, 0);
 
     /* Reset cursor to top-left position */
     term->cursor.logical_x = 0;
@@ -225,40 +667,300 @@ terminal_clear_impl(terminal_state_t *term)
     }
 }
 
+/*
+ * Moves the cursor of the specified terminal to the specified
+ * screen position, clamped to the screen. This starts a new
+ * logical line, so backspace can't cross back over it.
+ */
+static void
+terminal_set_cursor(terminal_state_t *term, int32_t x, int32_t y)
+{
+    if (x < 0) {
+        x = 0;
+    } else if (x >= NUM_COLS) {
+        x = NUM_COLS - 1;
+    }
+
+    if (y < 0) {
+        y = 0;
+    } else if (y >= NUM_ROWS) {
+        y = NUM_ROWS - 1;
+    }
+
+    term->cursor.logical_x = x;
+    term->cursor.screen_x = x;
+    term->cursor.screen_y = y;
+}
+
+/*
+ * Erases the characters between the specified screen
+ * positions (counted in characters from the top-left,
+ * start inclusive, end exclusive), using the current
+ * background color.
+ */
+static void
+terminal_erase(terminal_state_t *term, int32_t start, int32_t end)
+{
+    if (end > start) {
+        vga_fill_region(term->video_mem + (start << 1), term->attrib, end - start);
+    }
+}
+
+/*
+ * Handles an erase in display (mode = 'J') or erase in
+ * line (mode = 'K') command.
+ */
+static void
+terminal_exec_erase(terminal_state_t *term, uint8_t mode, int32_t param)
+{
+    int32_t pos = term->cursor.screen_y * NUM_COLS + term->cursor.screen_x;
+    int32_t first = 0;
+    int32_t last = NUM_ROWS * NUM_COLS;
+    if (mode == 'K') {
+        first = term->cursor.screen_y * NUM_COLS;
+        last = first + NUM_COLS;
+    }
+
+    switch (param) {
+    case 0: /* Cursor to end */
+        terminal_erase(term, pos, last);
+        break;
+    case 1: /* Start to cursor */
+        terminal_erase(term, first, pos + 1);
+        break;
+    case 2: /* Everything */
+        terminal_erase(term, first, last);
+        break;
+    }
+}
+
+/* Handles a select graphic rendition (color) command */
+static void
+terminal_exec_sgr(terminal_state_t *term, const ansi_cmd_t *cmd)
+{
+    int32_t i;
+    for (i = 0; i < cmd->num_params; ++i) {
+        int32_t param = ansi_param(cmd, i, 0);
+        uint8_t attrib = term->attrib;
+        if (param == 0) {
+            attrib = ATTRIB;
+        } else if (param == 1) {
+            attrib |= ATTRIB_BRIGHT;
+        } else if (param == 22) {
+            attrib &= ~ATTRIB_BRIGHT;
+        } else if (param >= 30 && param <= 37) {
+            attrib = (attrib & 0xf8) | ansi_colors[param - 30];
+        } else if (param == 39) {
+            attrib = (attrib & 0xf8) | (ATTRIB & 0x07);
+        } else if (param >= 40 && param <= 47) {
+            attrib = (attrib & 0x8f) | (ansi_colors[param - 40] << 4);
+        } else if (param == 49) {
+            attrib = (attrib & 0x8f) | (ATTRIB & 0x70);
+        } else if (param >= 90 && param <= 97) {
+            attrib = (attrib & 0xf0) | ansi_colors[param - 90] | ATTRIB_BRIGHT;
+        } else if (param >= 100 && param <= 107) {
+            /* No bright backgrounds, since that bit means blink */
+            attrib = (attrib & 0x8f) | (ansi_colors[param - 100] << 4);
+        }
+        term->attrib = attrib;
+    }
+}
+
+/* Resets the terminal to its initial state and clears it */
+static void
+terminal_reset(terminal_state_t *term)
+{
+    term->attrib = ATTRIB;
+    term->cursor_hidden = false;
+    term->scroll_top = 0;
+    term->scroll_bottom = NUM_ROWS - 1;
+    terminal_clear_impl(term);
+}
+
+/* Executes an escape sequence written to the specified terminal */
+static void
+terminal_exec_ansi(terminal_state_t *term, const ansi_cmd_t *cmd)
+{
+    cursor_pos_t *cursor = &term->cursor;
+    int32_t x = cursor->screen_x;
+    int32_t y = cursor->screen_y;
+
+    /* Plain escape sequences */
+    if (!cmd->csi) {
+        switch (cmd->final) {
+        case '7':
+            term->saved_cursor = *cursor;
+            break;
+        case '8':
+            terminal_set_cursor(term, term->saved_cursor.screen_x, term->saved_cursor.screen_y);
+            break;
+        case 'c':
+            terminal_reset(term);
+            break;
+        }
+        return;
+    }
+
+    /*
+     * The only DEC private mode we support is cursor visibility,
+     * so programs can hide the cursor without touching the CRTC.
+     */
+    if (cmd->private) {
+        if ((cmd->final == 'h' || cmd->final == 'l') &&
+            ansi_param(cmd, 0, 0) == ANSI_MODE_CURSOR) {
+            term->cursor_hidden = (cmd->final == 'l');
+            terminal_update_cursor(term);
+        }
+        return;
+    }
+
+    switch (cmd->final) {
+    case 'A': /* Cursor up */
+        terminal_set_cursor(term, x, y - ansi_param(cmd, 0, 1));
+        break;
+    case 'B': /* Cursor down */
+        terminal_set_cursor(term, x, y + ansi_param(cmd, 0, 1));
+        break;
+    case 'C': /* Cursor forward */
+        terminal_set_cursor(term, x + ansi_param(cmd, 0, 1), y);
+        break;
+    case 'D': /* Cursor back */
+        terminal_set_cursor(term, x - ansi_param(cmd, 0, 1), y);
+        break;
+    case 'G': /* Cursor horizontal absolute */
+        terminal_set_cursor(term, ansi_param(cmd, 0, 1) - 1, y);
+        break;
+    case 'd': /* Cursor vertical absolute */
+        terminal_set_cursor(term, x, ansi_param(cmd, 0, 1) - 1);
+        break;
+    case 'H': /* Cursor position */
+    case 'f':
+        terminal_set_cursor(term, ansi_param(cmd, 1, 1) - 1, ansi_param(cmd, 0, 1) - 1);
+        break;
+    case 'J': /* Erase in display */
+    case 'K': /* Erase in line */
+        terminal_exec_erase(term, cmd->final, ansi_param(cmd, 0, 0));
+        break;
+    case 'm': /* Select graphic rendition */
+        terminal_exec_sgr(term, cmd);
+        break;
+    case 'r': { /* Set scrolling region */
+        int32_t top = ansi_param(cmd, 0, 1) - 1;
+        int32_t bottom = ansi_param(cmd, 1, NUM_ROWS) - 1;
+        if (top < bottom && bottom < NUM_ROWS) {
+            term->scroll_top = top;
+            term->scroll_bottom = bottom;
+            terminal_set_cursor(term, 0, 0);
+        }
+        break;
+    }
+    case 's': /* Save cursor */
+        term->saved_cursor = *cursor;
+        break;
+    case 'u': /* Restore cursor */
+        terminal_set_cursor(term, term->saved_cursor.screen_x, term->saved_cursor.screen_y);
+        break;
+    }
+}
+
+/*
+ * Prints a buffer of characters to the specified terminal,
+ * interpreting any VT100/ANSI escape sequences in it. Runs of
+ * plain text in between the sequences are drawn in one go.
+ * This does NOT update the cursor position!
+ */
+static void
+terminal_puts_impl(terminal_state_t *term, const uint8_t *buf, int32_t nbytes)
+{
+    int32_t i = 0;
+    while (i < nbytes) {
+        /* Find the next run of plain text */
+        int32_t start = i;
+        if (term->ansi.state == ANSI_STATE_NORMAL) {
+            while (i < nbytes && buf[i] != ANSI_ESC) {
+                i++;
+            }
+        }
+
+        if (i > start) {
+            terminal_puts_text(term, &buf[start], i - start);
+            continue;
+        }
+
+        /* Inside an escape sequence, feed the parser */
+        ansi_cmd_t *cmd;
+        if (!ansi_parse(&term->ansi, buf[i], &cmd)) {
+            terminal_putc_impl(term, buf[i]);
+        } else if (cmd != NULL) {
+            terminal_exec_ansi(term, cmd);
+        }
+        i++;
+    }
+}
+
+/*
+ * Draws any output that has been written to the specified
+ * terminal but not yet drawn, then updates the cursor position.
+ */
+static void
+terminal_flush(terminal_state_t *term)
+{
+    output_buf_t *out = &term->output;
+    if (out->count == 0) {
+        return;
+    }
+
+    terminal_puts_impl(term, out->buf, out->count);
+    out->count = 0;
+    terminal_update_cursor(term);
+}
+
 /*
  * Sets the index of the DISPLAYED terminal. This is
  * NOT the same as the EXECUTING terminal! The index
- * must be in the range [0, NUM_TERMINALS).
+ * must be in the range [0, get_num_terminals()).
  */
 void
 set_display_terminal(int32_t index)
 {
-    ASSERT(index >= 0 && index < NUM_TERMINALS);
+    ASSERT(index >= 0 && index < num_terminals);
     int32_t old_index = display_terminal;
     if (index == old_index) {
         return;
     }
 
-    /* Set the new display terminal */
+    /* Stop viewing the history on the old terminal */
     terminal_state_t *old = get_display_terminal();
+    terminal_scroll_history(old, -old->history.view_offset);
+
+    /* Set the new display terminal */
     display_terminal = index;
     terminal_state_t *new = get_display_terminal();
 
-    /* Swap active VGA memory buffers */
-    terminal_swap_buffer(old, new);
+    /* Switch graphics on or off if a program is using them */
+    vbe_update_display(index);
+    vga_cursor_hidden = -1;
+
+    /*
+     * The new terminal's screen is already resident in VGA
+     * memory, so we just need to draw whatever was written
+     * to it while it was hidden and point the CRTC at it.
+     */
+    terminal_flush(new);
+    terminal_update_start(new);
 
     /* Update the cursor position for the new terminal screen */
     terminal_update_cursor(new);
 
-    /*
-     * If the currently executing process has a vidmap
-     * page and that terminal had its active memory buffer
-     * swapped, update the vidmap page.
-     */
-    terminal_state_t *exec = get_executing_terminal();
-    if (exec->vidmap && (old == exec || new == exec)) {
-        paging_update_vidmap_page(exec->video_mem, true);
-    }
+    /* Give the terminal a shell if this is its first time on screen */
+    process_start_terminal(index);
+}
+
+/* Gets the index of the currently displayed terminal */
+int32_t
+get_display_terminal_index(void)
+{
+    return display_terminal;
 }
 
 /* Prints a character to the currently displayed terminal */
@@ -266,8 +968,13 @@ void
 terminal_putc(uint8_t c)
 {
     terminal_state_t *term = get_display_terminal();
+    terminal_flush(term);
     terminal_putc_impl(term, c);
     terminal_update_cursor(term);
+
+    if (serial_terminal == TERMINAL_SERIAL_KERNEL) {
+        terminal_serial_write(&c, 1);
+    }
 }
 
 /* Clears the curently displayed terminal screen */
@@ -275,6 +982,10 @@ void
 terminal_clear(void)
 {
     terminal_state_t *term = get_display_terminal();
+
+    /* Earlier output still belongs in the history */
+    terminal_flush(term);
+
     terminal_clear_impl(term);
     term->kbd_input.count = 0;
 }
@@ -322,15 +1033,8 @@ terminal_wait_kbd_input(kbd_input_buf_t *input_buf, int32_t nbytes)
             return -1;
         }
 
-        /*
-         * Wait for some more input (nicely, to save CPU cycles).
-         * There's no race condition between sti and hlt here,
-         * since sti will only take effect after the following
-         * instruction (hlt) has been executed.
-         */
-        sti();
-        hlt();
-        cli();
+        /* Wait for some more input (nicely, to save CPU cycles) */
+        process_idle();
     }
 
     return nbytes;
@@ -369,6 +1073,15 @@ terminal_stdin_read(file_obj_t *file, void *buf, int32_t nbytes)
     terminal_state_t *term = get_executing_terminal();
     kbd_input_buf_t *input_buf = &term->kbd_input;
 
+    /*
+     * The first read is the first shell waiting at its prompt,
+     * so the timestamp on this message is the boot time.
+     */
+    if (!prompt_reached) {
+        prompt_reached = true;
+        klog(KLOG_INFO, "Reached first prompt\n");
+    }
+
     /* Only allow reads up to the end of the buffer */
     if (nbytes > KEYBOARD_BUF_SIZE) {
         nbytes = KEYBOARD_BUF_SIZE;
@@ -422,6 +1135,14 @@ terminal_stdout_read(file_obj_t *file, void *buf, int32_t nbytes)
  * in buf to the terminal. The buffer should not contain any
  * NUL characters. Returns the number of characters written.
  *
+ * The characters are not drawn right away; they are appended
+ * to the terminal's output buffer, which is drawn on the next
+ * frame tick if the terminal is displayed, or when it is next
+ * switched to otherwise. This way, a process writing lots of
+ * small chunks only costs one screen update per frame, and
+ * processes in hidden terminals mostly don't touch video
+ * memory at all.
+ *
  * file - ignored.
  * buf - must point to a uint8_t array
  * nbytes - the number of characters to write to the terminal
@@ -440,15 +1161,26 @@ terminal_stdout_write(file_obj_t *file, const void *buf, int32_t nbytes)
 
     const uint8_t *src = (const uint8_t *)buf;
     terminal_state_t *term = get_executing_terminal();
+    output_buf_t *out = &term->output;
 
-    /* Print characters to the terminal (don't update cursor) */
-    int32_t i;
-    for (i = 0; i < nbytes; ++i) {
-        terminal_putc_impl(term, src[i]);
+    /* The serial port has its own buffer, so send it right away */
+    if (is_serial_terminal(term)) {
+        terminal_serial_write(src, nbytes);
     }
 
-    /* Update cursor position */
-    terminal_update_cursor(term);
+    /* Make room in the output buffer if necessary */
+    if (out->count + nbytes > TERMINAL_OUTPUT_BUF_SIZE) {
+        terminal_flush(term);
+    }
+
+    if (nbytes > TERMINAL_OUTPUT_BUF_SIZE) {
+        /* Too big to buffer, just draw it directly */
+        terminal_puts_impl(term, src, nbytes);
+        terminal_update_cursor(term);
+    } else {
+        memcpy(&out->buf[out->count], src, nbytes);
+        out->count += nbytes;
+    }
 
     return nbytes;
 }
@@ -503,8 +1235,9 @@ terminal_mouse_read(file_obj_t *file, void *buf, int32_t nbytes)
     }
 
     /* Shift remaining inputs to the front */
-    memmove((void *)&input_buf->buf[0], (void *)&input_buf->buf[num_copy], num_bytes_copy);
     input_buf->count -= num_copy;
+    memmove((void *)&input_buf->buf[0], (void *)&input_buf->buf[num_copy],
+            input_buf->count * sizeof(mouse_input_t));
 
     /* Return the number of bytes copied into the buffer */
     return num_bytes_copy;
@@ -530,12 +1263,12 @@ terminal_mouse_close(file_obj_t *file)
 
 /*
  * Handles CTRL-C input by sending an interrupt signal
- * to the process executing in the current terminal.
+ * to the process executing in the specified terminal.
  */
 static void
-terminal_interrupt(void)
+terminal_interrupt(int32_t index)
 {
-    pcb_t *pcb = get_pcb_by_terminal(display_terminal);
+    pcb_t *pcb = get_pcb_by_terminal(index);
     if (pcb == NULL) {
         debugf("No process running in display terminal\n");
         return;
@@ -553,12 +1286,31 @@ handle_ctrl_input(kbd_input_ctrl_t ctrl)
         terminal_clear();
         break;
     case KCTL_INTERRUPT:
-        terminal_interrupt();
+        terminal_interrupt(display_terminal);
         break;
     case KCTL_TERM1:
     case KCTL_TERM2:
     case KCTL_TERM3:
-        set_display_terminal(ctrl - KCTL_TERM1);
+    case KCTL_TERM4:
+    case KCTL_TERM5:
+    case KCTL_TERM6:
+    case KCTL_TERM7:
+    case KCTL_TERM8:
+    case KCTL_TERM9:
+    case KCTL_TERM10:
+    case KCTL_TERM11:
+    case KCTL_TERM12:
+        /* Ignore keys for terminals that don't exist */
+        if (ctrl - KCTL_TERM1 < num_terminals) {
+            set_display_terminal(ctrl - KCTL_TERM1);
+        }
+        break;
+    case KCTL_SCROLL_UP:
+        terminal_flush(get_display_terminal());
+        terminal_scroll_history(get_display_terminal(), NUM_ROWS);
+        break;
+    case KCTL_SCROLL_DOWN:
+        terminal_scroll_history(get_display_terminal(), -NUM_ROWS);
         break;
     default:
         ASSERT(0);
@@ -566,24 +1318,40 @@ handle_ctrl_input(kbd_input_ctrl_t ctrl)
     }
 }
 
-/* Handles single-character keyboard input */
+/*
+ * Handles single-character input to the specified terminal,
+ * from either the keyboard or the serial port.
+ */
 static void
-handle_char_input(uint8_t c)
+handle_char_input(terminal_state_t *term, uint8_t c)
 {
-    /* We should insert characters into the currently displayed
-     * terminal's input stream, not the currently executing terminal.
-     */
-    terminal_state_t *term = get_display_terminal();
     kbd_input_buf_t *input_buf = &term->kbd_input;
+
+    /* Typing jumps back to the live screen */
+    terminal_scroll_history(term, -term->history.view_offset);
+
+    /* Echo after any output that is still pending */
+    terminal_flush(term);
+
     if (c == '\b' && input_buf->count > 0 && term->cursor.logical_x > 0) {
         input_buf->count--;
         terminal_putc_impl(term, c);
         terminal_update_cursor(term);
+
+        /* Erase the character on the other end too */
+        if (is_serial_terminal(term)) {
+            static const uint8_t erase[] = {'\b', ' ', '\b'};
+            serial_write(erase, sizeof(erase));
+        }
     } else if ((c != '\b' && input_buf->count < KEYBOARD_BUF_SIZE - 1) ||
                (c == '\n' && input_buf->count < KEYBOARD_BUF_SIZE)) {
         input_buf->buf[input_buf->count++] = c;
         terminal_putc_impl(term, c);
         terminal_update_cursor(term);
+
+        if (is_serial_terminal(term)) {
+            terminal_serial_write(&c, 1);
+        }
     }
 }
 
@@ -593,7 +1361,11 @@ terminal_handle_kbd_input(kbd_input_t input)
 {
     switch (input.type) {
     case KTYP_CHAR:
-        handle_char_input(input.value.character);
+        /*
+         * We should insert characters into the currently displayed
+         * terminal's input stream, not the currently executing terminal.
+         */
+        handle_char_input(get_display_terminal(), input.value.character);
         break;
     case KTYP_CTRL:
         handle_ctrl_input(input.value.control);
@@ -606,6 +1378,67 @@ terminal_handle_kbd_input(kbd_input_t input)
     }
 }
 
+/*
+ * Handles a character received from the serial port. This
+ * goes to the terminal bound to the serial port, if any.
+ */
+void
+terminal_handle_serial_input(uint8_t c)
+{
+    if (serial_terminal < 0) {
+        return;
+    }
+
+    /* Translate what terminal emulators send for Enter, Backspace, ^C */
+    if (c == '\r') {
+        c = '\n';
+    } else if (c == SERIAL_CHAR_DEL) {
+        c = '\b';
+    } else if (c == SERIAL_CHAR_ETX) {
+        terminal_interrupt(serial_terminal);
+        return;
+    }
+
+    process_start_terminal(serial_terminal);
+    handle_char_input(get_terminal(serial_terminal), c);
+}
+
+/*
+ * Binds a terminal to the serial port: everything written to its
+ * stdout is also sent over the serial port, and characters received
+ * on the serial port are treated as keyboard input to it. The index
+ * may also be TERMINAL_SERIAL_KERNEL to send kernel output (printf)
+ * instead, or TERMINAL_SERIAL_NONE to unbind.
+ */
+void
+terminal_bind_serial(int32_t index)
+{
+    ASSERT(index == TERMINAL_SERIAL_NONE ||
+           index == TERMINAL_SERIAL_KERNEL ||
+           (index >= 0 && index < num_terminals));
+    serial_terminal = index;
+}
+
+/*
+ * Sets the number of terminals in use. This must be called
+ * before any processes are started, and before binding a
+ * terminal to the serial port.
+ */
+void
+terminal_set_count(int32_t count)
+{
+    ASSERT(count >= 1 && count <= MAX_TERMINALS);
+    ASSERT(display_terminal < count);
+    num_terminals = count;
+}
+
+/* Gets the number of terminals in use */
+int32_t
+get_num_terminals(void)
+{
+    return num_terminals;
+}
+
 /* Handles input from the mouse */
 void
 terminal_handle_mouse_input(mouse_input_t input)
@@ -619,6 +1452,46 @@ terminal_handle_mouse_input(mouse_input_t input)
     }
 }
 
+/*
+ * cell_blit() syscall handler. Copies a rect->w x rect->h block
+ * of (character, attribute) cells from userspace to position
+ * (rect->x, rect->y) of the executing process's terminal screen.
+ * This bypasses the cursor and escape sequence handling, and
+ * never scrolls. Returns -1 if the rectangle doesn't fit on
+ * the screen.
+ */
+__cdecl int32_t
+terminal_cell_blit(const uint16_t *cells, const cell_rect_t *rect)
+{
+    if (!is_user_readable(rect, sizeof(cell_rect_t))) {
+        return -1;
+    }
+
+    /* Copy the rectangle so it can't change under us */
+    cell_rect_t r = *rect;
+    if (r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0 ||
+        r.w > NUM_COLS - r.x || r.h > NUM_ROWS - r.y) {
+        return -1;
+    }
+
+    int32_t row_bytes = r.w * sizeof(uint16_t);
+    if (!is_user_readable(cells, row_bytes * r.h)) {
+        return -1;
+    }
+
+    /* Earlier output should end up underneath */
+    terminal_state_t *term = get_terminal(get_executing_pcb()->terminal);
+    terminal_flush(term);
+
+    int32_t y;
+    for (y = 0; y < r.h; ++y) {
+        uint8_t *dest = term->video_mem + (r.y + y) * BYTES_PER_ROW + r.x * 2;
+        memcpy(dest, &cells[y * r.w], row_bytes);
+    }
+
+    return 0;
+}
+
 /*
  * Updates the vidmap page to point to the specified terminal's
  * active video memory page. If present is false, the vidmap page
@@ -628,10 +1501,131 @@ void
 terminal_update_vidmap(int32_t term_index, bool present)
 {
     terminal_state_t *term = get_terminal(term_index);
-    paging_update_vidmap_page(term->video_mem, present);
+
+    /*
+     * Anything written to stdout before calling vidmap should
+     * be on screen before the program starts drawing over it.
+     */
+    if (present && !term->vidmap) {
+        terminal_flush(term);
+    }
+
+    /* Releasing vidmap also ends double buffering */
+    if (!present) {
+        term->vidmap_back = NULL;
+    }
+
+    /*
+     * Programs using vidmap expect the screen to begin at the
+     * start of the page, so move it back there if we have
+     * scrolled forward. It then stays put until vidmap is
+     * released (see terminal_scroll_down).
+     */
+    if (present && term->vidmap_back == NULL && term->video_mem != term->vga_base) {
+        terminal_move_screen(term, term->vga_base, VIDEO_MEM_SIZE);
+        terminal_update_cursor(term);
+    }
+
+    if (term->vidmap_back != NULL) {
+        paging_update_vidmap_page(term->vidmap_back, present);
+    } else {
+        paging_update_vidmap_page(term->video_mem, present);
+    }
     term->vidmap = present;
 }
 
+/*
+ * Switches the terminal's vidmap page to double-buffered mode.
+ * The program then draws to the second page of the terminal's
+ * region while the first one stays on screen, until it calls
+ * terminal_vidmap_present. vidmap must already be enabled.
+ */
+void
+terminal_vidmap_buffered(int32_t term_index)
+{
+    terminal_state_t *term = get_terminal(term_index);
+    ASSERT(term->vidmap);
+    if (term->vidmap_back != NULL) {
+        return;
+    }
+
+    /* The screen is at vga_base, so the other page is free */
+    ASSERT(term->video_mem == term->vga_base);
+    term->vidmap_back = term->vga_base + TERMINAL_PAGE_SIZE;
+    memcpy(term->vidmap_back, term->video_mem, VIDEO_MEM_SIZE);
+    paging_update_vidmap_page(term->vidmap_back, true);
+}
+
+/*
+ * Waits for the next frame, then displays the vidmap back
+ * buffer by pointing the CRTC at it. The CRTC only latches
+ * a new start address at the start of vertical retrace, so
+ * the address is written outside retrace, and the old page
+ * isn't touched until the next retrace has begun and it is
+ * no longer being scanned out. If the retrace bit doesn't
+ * work, the page is flipped on the frame tick alone. The
+ * new back buffer starts out as a copy of what is now on
+ * screen. Returns -1 if the terminal isn't double-buffered,
+ * or if interrupted by a signal.
+ */
+int32_t
+terminal_vidmap_present(int32_t term_index)
+{
+    terminal_state_t *term = get_terminal(term_index);
+    if (term->vidmap_back == NULL) {
+        return -1;
+    }
+
+    /* Sleep until the next frame tick */
+    uint32_t frame = frame_count;
+    while (frame_count == frame) {
+        if (signal_has_pending()) {
+            return -1;
+        }
+
+        process_idle();
+    }
+
+    /* Don't write the start address in the middle of a retrace */
+    bool displayed = (term == get_display_terminal());
+    if (displayed) {
+        vga_wait_retrace(false);
+    }
+
+    /* Swap the pages */
+    uint8_t *front = term->vidmap_back;
+    term->vidmap_back = term->video_mem;
+    term->video_mem = front;
+    terminal_update_start(term);
+    terminal_update_cursor(term);
+
+    /* Wait for the CRTC to latch the new page before reusing the old one */
+    if (displayed) {
+        vga_wait_retrace(true);
+    }
+
+    memcpy(term->vidmap_back, term->video_mem, VIDEO_MEM_SIZE);
+    paging_update_vidmap_page(term->vidmap_back, true);
+    return 0;
+}
+
+/*
+ * Draws pending output to the displayed terminal once every
+ * TERMINAL_FRAME_TICKS ticks. Must be called from the PIT
+ * interrupt handler.
+ */
+void
+terminal_tick(void)
+{
+    if (++frame_ticks < TERMINAL_FRAME_TICKS) {
+        return;
+    }
+
+    frame_ticks = 0;
+    frame_count++;
+    terminal_flush(get_display_terminal());
+}
+
 /*
  * Initialize all terminals. This must be called before
  * any printing functions!
@@ -641,24 +1635,39 @@ terminal_init(void)
 {
     int32_t i;
 
-    for (i = 0; i < NUM_TERMINALS; ++i) {
+    /* Make sure all the terminal screens fit in VGA memory */
+    ASSERT(MAX_TERMINALS * TERMINAL_VGA_SIZE + TERMINAL_VIEW_SIZE <=
+           VIDEO_PAGE_END - VIDEO_PAGE_START);
+
+    /*
+     * Map the whole 128KB of VGA memory at 0xA0000 instead of
+     * just the 32KB at 0xB8000. The CRTC addresses all of it
+     * in text mode, this only changes what the CPU can reach.
+     */
+    outb(VGA_GC_MISC, VGA_GC_INDEX);
+    outb(inb(VGA_GC_DATA) & ~VGA_GC_MEMORY_MAP, VGA_GC_DATA);
+
+    /*
+     * Set up every terminal that might be used, since we don't
+     * know the real count until the command line is parsed.
+     */
+    for (i = 0; i < MAX_TERMINALS; ++i) {
         /*
-         * Backing memory is the per-terminal page
+         * Each terminal gets its own region of VGA memory.
          * Note that it's safe to do this before initializing paging
          * since everything is accessible at that point
          */
-        terminal_states[i].backing_mem = (uint8_t *)TERMINAL_PAGE_START + KB(i * 4);
-
-        /* Active memory points to the backing memory */
-        terminal_states[i].video_mem = terminal_states[i].backing_mem;
+        terminal_states[i].vga_base = VGA_MEMORY + i * TERMINAL_VGA_SIZE;
+        terminal_states[i].video_mem = terminal_states[i].vga_base;
+        terminal_states[i].attrib = ATTRIB;
+        terminal_states[i].scroll_top = 0;
+        terminal_states[i].scroll_bottom = NUM_ROWS - 1;
 
         /* Initialize the terminal memory region */
-        vga_clear_region(terminal_states[i].backing_mem, VIDEO_MEM_SIZE / 2);
+        vga_clear_region(&terminal_states[i], terminal_states[i].vga_base, VIDEO_MEM_SIZE / 2);
     }
 
-    /* First terminal's active video memory points to global VGA memory */
-    terminal_states[0].video_mem = VGA_MEMORY;
-
     /* Set initially displayed terminal */
     display_terminal = 0;
+    terminal_update_start(get_display_terminal());
 }
@@ -5,19 +5,81 @@
 #include "file.h"
 #include "keyboard.h"
 #include "mouse.h"
+#include "ansi.h"
 
-#define NUM_TERMINALS 3
+/*
+ * Maximum number of terminals (one per Alt+Fn key), and the number
+ * used if the "terminals" boot option isn't given.
+ */
+#define MAX_TERMINALS     12
+#define DEFAULT_TERMINALS 3
 
 #define NUM_COLS  80
 #define NUM_ROWS  25
 #define ATTRIB    0x7
 #define VIDEO_MEM_SIZE (NUM_ROWS * NUM_COLS * 2)
 
+/*
+ * Size of the VGA text memory region owned by each terminal.
+ * This is larger than one screen so that we can scroll by moving
+ * the CRTC start address forward, only copying the screen back
+ * to the start of the region once we run off the end.
+ */
+#define TERMINAL_VGA_SIZE 0x2000
+
+/*
+ * Size of one screen page within a terminal's region. Programs
+ * using double-buffered vidmap draw to one page while the other
+ * is displayed.
+ */
+#define TERMINAL_PAGE_SIZE 0x1000
+
+/*
+ * Size of the VGA text memory page used to display the scrollback
+ * history. This sits at the very end of VGA memory, after all the
+ * terminal regions.
+ */
+#define TERMINAL_VIEW_SIZE 0x1000
+
+/* Number of rows of scrollback history kept for each terminal */
+#define TERMINAL_HISTORY_ROWS 200
+
+/*
+ * Size of the buffer holding output that has been written to a
+ * terminal but not yet drawn to the screen
+ */
+#define TERMINAL_OUTPUT_BUF_SIZE 4096
+
+/* Rate (in Hz) at which pending output is drawn to the display */
+#define TERMINAL_FRAME_RATE 50
+
+/* Values for terminal_bind_serial() that aren't terminal indices */
+#define TERMINAL_SERIAL_NONE   -1 /* Nothing uses the serial port */
+#define TERMINAL_SERIAL_KERNEL -2 /* Kernel output goes to the serial port */
+
+/* Control characters received from serial terminals */
+#define SERIAL_CHAR_ETX 0x03 /* Ctrl-C */
+#define SERIAL_CHAR_DEL 0x7F /* Backspace */
+
 /* VGA registers */
+#define VGA_REG_CURSOR_START 0x0A
+#define VGA_CURSOR_DISABLE 0x20 /* Cursor off bit in VGA_REG_CURSOR_START */
+#define VGA_REG_START_HI  0x0C
+#define VGA_REG_START_LO  0x0D
 #define VGA_REG_CURSOR_HI 0x0E
 #define VGA_REG_CURSOR_LO 0x0F
 #define VGA_PORT_INDEX    0x3D4
 #define VGA_PORT_DATA     0x3D5
+#define VGA_PORT_STATUS   0x3DA
+#define VGA_STATUS_RETRACE 0x08 /* Vertical retrace bit in VGA_PORT_STATUS */
+#define VGA_GC_INDEX      0x3CE
+#define VGA_GC_DATA       0x3CF
+#define VGA_GC_MISC       0x06
+#define VGA_GC_MEMORY_MAP 0x0C /* Memory map select bits in VGA_GC_MISC */
+
+/* All the VGA registers, which belong to the terminal driver */
+#define VGA_PORT_FIRST    0x3C0
+#define VGA_PORT_LAST     0x3DF
 
 #ifndef ASM
 
@@ -39,6 +101,41 @@ typedef struct {
     int32_t screen_y;
 } cursor_pos_t;
 
+/* Scrollback history ring buffer */
+typedef struct {
+    /* Rows that have scrolled off the top of the screen */
+    uint8_t rows[TERMINAL_HISTORY_ROWS][NUM_COLS * 2];
+
+    /* Index of the row that will be written next */
+    int32_t head;
+
+    /* Number of valid rows in the buffer */
+    int32_t count;
+
+    /*
+     * Number of rows the view is scrolled back by. If this is 0,
+     * the live screen is being displayed.
+     */
+    int32_t view_offset;
+} history_buf_t;
+
+/* Pending output buffer */
+typedef struct {
+    /* Characters that have not been drawn to the screen yet */
+    uint8_t buf[TERMINAL_OUTPUT_BUF_SIZE];
+
+    /* Number of characters in the buffer */
+    int32_t count;
+} output_buf_t;
+
+/* Rectangle of character cells, for terminal_cell_blit() */
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} cell_rect_t;
+
 /* Combined terminal state information */
 typedef struct {
     /* Keyboard input buffer */
@@ -47,17 +144,49 @@ typedef struct {
     /* Mouse input buffer */
     mouse_input_buf_t mouse_input;
 
-    /* Cursor position */
+    /* Output waiting to be drawn */
+    output_buf_t output;
+
+    /* Cursor position (as of the last drawn character) */
     cursor_pos_t cursor;
 
-    /* Backing video memory */
-    uint8_t *backing_mem;
+    /* Cursor position saved by ESC 7 or ESC [ s */
+    cursor_pos_t saved_cursor;
+
+    /* Escape sequence parser for output */
+    ansi_parser_t ansi;
+
+    /* Attribute byte used for newly drawn characters */
+    uint8_t attrib;
+
+    /* Whether the cursor was hidden with ESC [ ? 25 l */
+    bool cursor_hidden;
 
     /*
-     * Pointer to the video memory where the contents
-     * of this terminal should be displayed. Either points
-     * to the global VGA video memory or to the per-terminal
-     * backing_mem field.
+     * First and last rows (inclusive) of the scrolling region.
+     * Only output that runs off the bottom of a full-screen
+     * region goes into the scrollback history.
+     */
+    int32_t scroll_top;
+    int32_t scroll_bottom;
+
+    /* Scrollback history */
+    history_buf_t history;
+
+    /*
+     * Start of the region of VGA text memory that belongs to
+     * this terminal. The terminal's screen always lives somewhere
+     * inside this region, even when it is not being displayed,
+     * so switching terminals only requires updating the CRTC
+     * start address.
+     */
+    uint8_t *vga_base;
+
+    /*
+     * Pointer to the top-left character of the terminal screen.
+     * This moves forward through vga_base as the terminal scrolls.
+     * If vidmap is true, this is pinned to vga_base (or to the
+     * second page, when flipping with double-buffered vidmap).
      */
     uint8_t *video_mem;
 
@@ -66,6 +195,13 @@ typedef struct {
      * has called vidmap.
      */
     bool vidmap;
+
+    /*
+     * If the process is using double-buffered vidmap, this is
+     * the page it draws to (the other page of the region from
+     * video_mem). NULL otherwise.
+     */
+    uint8_t *vidmap_back;
 } terminal_state_t;
 
 /* Terminal syscall functions */
@@ -85,6 +221,9 @@ int32_t terminal_mouse_close(file_obj_t *file);
 /* Sets the currently displayed terminal */
 void set_display_terminal(int32_t index);
 
+/* Gets the index of the currently displayed terminal */
+int32_t get_display_terminal_index(void);
+
 /* Prints a character to the curently executing terminal */
 void terminal_putc(uint8_t c);
 
@@ -100,9 +239,33 @@ void terminal_handle_kbd_input(kbd_input_t input);
 /* Handles mouse input */
 void terminal_handle_mouse_input(mouse_input_t input);
 
+/* Handles input from the serial port */
+void terminal_handle_serial_input(uint8_t c);
+
+/* Binds a terminal (or the kernel output) to the serial port */
+void terminal_bind_serial(int32_t index);
+
+/* Sets the number of terminals in use */
+void terminal_set_count(int32_t count);
+
+/* Gets the number of terminals in use */
+int32_t get_num_terminals(void);
+
+/* Draws pending output to the displayed terminal, called on each PIT tick */
+void terminal_tick(void);
+
 /* Updates the vidmap status for the specified terminal */
 void terminal_update_vidmap(int32_t term_index, bool present);
 
+/* cell_blit() syscall handler */
+__cdecl int32_t terminal_cell_blit(const uint16_t *cells, const cell_rect_t *rect);
+
+/* Switches the terminal's vidmap page to double-buffered mode */
+void terminal_vidmap_buffered(int32_t term_index);
+
+/* Displays the vidmap back buffer on the next frame */
+int32_t terminal_vidmap_present(int32_t term_index);
+
 /* Initializes the terminal */
 void terminal_init(void);
 
@@ -0,0 +1,426 @@
+#include "vbe.h"
+#include "lib.h"
+#include "debug.h"
+#include "pci.h"
+#include "paging.h"
+#include "process.h"
+#include "terminal.h"
+
+/* VGA CRT and graphics controller registers */
+#define VGA_CRTC_INDEX    0x3D4
+#define VGA_CRTC_DATA     0x3D5
+#define VGA_NUM_CRTC_REGS 0x19
+#define VGA_NUM_GC_REGS   0x09
+
+/* CRTC registers that we must not restore (see vbe_restore_vga) */
+#define VGA_CRTC_START_HI  0x0C
+#define VGA_CRTC_CURSOR_LO 0x0F
+#define VGA_CRTC_V_RETRACE_END 0x11
+#define VGA_CRTC_PROTECT   0x80
+
+#define BYTES_PER_PIXEL (VBE_BPP / 8)
+
+#define ALIGN_4KB __attribute__((aligned(KB(4))))
+
+/* Dirty rectangle, in [x0, x1) x [y0, y1) form */
+typedef struct {
+    int32_t x0;
+    int32_t y0;
+    int32_t x1;
+    int32_t y1;
+} dirty_rect_t;
+
+/* Whether a usable adapter was found */
+static bool vbe_present = false;
+
+/* Kernel address of the linear frame buffer */
+static uint8_t *vbe_lfb = NULL;
+
+/* Process that owns the graphics mode, or -1 if in text mode */
+static int32_t owner_pid = -1;
+
+/* Terminal of the owning process */
+static int32_t owner_terminal = -1;
+
+/* Whether the graphics mode is currently on screen */
+static bool displayed = false;
+
+/* Current mode parameters */
+static int32_t mode_width;
+static int32_t mode_height;
+static uint32_t mode_flags;
+
+/* First frame buffer row that we draw to (after the text memory) */
+static int32_t first_row;
+
+/* Page being shown, and page being drawn to */
+static int32_t front_page;
+static int32_t back_page;
+
+/* Region of the back page drawn since the last flip */
+static dirty_rect_t dirty;
+
+/* Saved text mode register state */
+static uint8_t saved_crtc[VGA_NUM_CRTC_REGS];
+static uint8_t saved_gc[VGA_NUM_GC_REGS];
+
+/* Where the terminals' text memory lives while graphics are shown */
+static ALIGN_4KB uint8_t text_shadow[VIDEO_PAGE_END - VIDEO_PAGE_START];
+
+/* Reads a DISPI register */
+static uint16_t
+vbe_read_register(uint16_t index)
+{
+    outw(index, VBE_PORT_INDEX);
+    return inw(VBE_PORT_DATA);
+}
+
+/* Writes a DISPI register */
+static void
+vbe_write_register(uint16_t index, uint16_t value)
+{
+    outw(index, VBE_PORT_INDEX);
+    outw(value, VBE_PORT_DATA);
+}
+
+/* Returns the number of bytes in one row of the frame buffer */
+static int32_t
+vbe_pitch(void)
+{
+    return mode_width * BYTES_PER_PIXEL;
+}
+
+/* Returns the first frame buffer row of the specified page */
+static int32_t
+vbe_page_row(int32_t page)
+{
+    return first_row + page * mode_height;
+}
+
+/* Returns a pointer to pixel (x, y) of the specified page */
+static uint8_t *
+vbe_pixel(int32_t page, int32_t x, int32_t y)
+{
+    int32_t row = vbe_page_row(page) + y;
+    return vbe_lfb + row * vbe_pitch() + x * BYTES_PER_PIXEL;
+}
+
+/*
+ * Saves the VGA registers that the adapter rewrites when
+ * the DISPI interface is enabled.
+ */
+static void
+vbe_save_vga(void)
+{
+    int32_t i;
+    for (i = 0; i < VGA_NUM_CRTC_REGS; ++i) {
+        outb(i, VGA_CRTC_INDEX);
+        saved_crtc[i] = inb(VGA_CRTC_DATA);
+    }
+    for (i = 0; i < VGA_NUM_GC_REGS; ++i) {
+        outb(i, VGA_GC_INDEX);
+        saved_gc[i] = inb(VGA_GC_DATA);
+    }
+}
+
+/*
+ * Restores the registers saved by vbe_save_vga. The start
+ * address and cursor registers are skipped, since the terminal
+ * code keeps updating those while the graphics mode is up.
+ */
+static void
+vbe_restore_vga(void)
+{
+    int32_t i;
+
+    /* Registers 0-7 are write-protected until this bit is cleared */
+    outb(VGA_CRTC_V_RETRACE_END, VGA_CRTC_INDEX);
+    outb(saved_crtc[VGA_CRTC_V_RETRACE_END] & ~VGA_CRTC_PROTECT, VGA_CRTC_DATA);
+
+    for (i = 0; i < VGA_NUM_CRTC_REGS; ++i) {
+        if (i >= VGA_CRTC_START_HI && i <= VGA_CRTC_CURSOR_LO) {
+            continue;
+        }
+        outb(i, VGA_CRTC_INDEX);
+        outb(saved_crtc[i], VGA_CRTC_DATA);
+    }
+    for (i = 0; i < VGA_NUM_GC_REGS; ++i) {
+        outb(i, VGA_GC_INDEX);
+        outb(saved_gc[i], VGA_GC_DATA);
+    }
+}
+
+/*
+ * Switches the display into the current graphics mode. The
+ * terminals' text memory is moved into RAM first, since the
+ * legacy VGA window doesn't reach it in this mode.
+ */
+static void
+vbe_show(void)
+{
+    ASSERT(!displayed);
+
+    memcpy(text_shadow, (void *)VIDEO_PAGE_START, sizeof(text_shadow));
+    paging_set_video_backing(text_shadow);
+    vbe_save_vga();
+
+    vbe_write_register(VBE_REG_ENABLE, 0);
+    vbe_write_register(VBE_REG_XRES, mode_width);
+    vbe_write_register(VBE_REG_YRES, mode_height);
+    vbe_write_register(VBE_REG_BPP, VBE_BPP);
+    vbe_write_register(VBE_REG_ENABLE, VBE_ENABLED | VBE_LFB_ENABLED | VBE_NOCLEARMEM);
+    vbe_write_register(VBE_REG_VIRT_WIDTH, mode_width);
+    vbe_write_register(VBE_REG_X_OFFSET, 0);
+    vbe_write_register(VBE_REG_Y_OFFSET, vbe_page_row(front_page));
+    displayed = true;
+}
+
+/* Switches the display back to text mode */
+static void
+vbe_hide(void)
+{
+    ASSERT(displayed);
+
+    vbe_write_register(VBE_REG_ENABLE, 0);
+    vbe_restore_vga();
+    paging_set_video_backing(NULL);
+    memcpy((void *)VIDEO_PAGE_START, text_shadow, sizeof(text_shadow));
+    displayed = false;
+}
+
+/* Adds a rectangle to the dirty region */
+static void
+vbe_mark_dirty(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    if (dirty.x0 >= dirty.x1) {
+        dirty.x0 = x;
+        dirty.y0 = y;
+        dirty.x1 = x + w;
+        dirty.y1 = y + h;
+        return;
+    }
+
+    if (x < dirty.x0) {
+        dirty.x0 = x;
+    }
+    if (y < dirty.y0) {
+        dirty.y0 = y;
+    }
+    if (x + w > dirty.x1) {
+        dirty.x1 = x + w;
+    }
+    if (y + h > dirty.y1) {
+        dirty.y1 = y + h;
+    }
+}
+
+/*
+ * Shows the back page. The new back page is then one frame
+ * behind, so we bring it up to date by copying across the
+ * region that was drawn this frame. This way programs only
+ * ever have to send what changed.
+ */
+static void
+vbe_flip(void)
+{
+    front_page = back_page;
+    back_page = !back_page;
+    if (displayed) {
+        vbe_write_register(VBE_REG_Y_OFFSET, vbe_page_row(front_page));
+    }
+
+    int32_t y;
+    int32_t row_bytes = (dirty.x1 - dirty.x0) * BYTES_PER_PIXEL;
+    for (y = dirty.y0; y < dirty.y1; ++y) {
+        memcpy(vbe_pixel(back_page, dirty.x0, y),
+               vbe_pixel(front_page, dirty.x0, y),
+               row_bytes);
+    }
+
+    dirty.x0 = dirty.x1 = 0;
+    dirty.y0 = dirty.y1 = 0;
+}
+
+/*
+ * Releases the graphics mode if it is owned by the specified
+ * process, switching back to text mode. This is called when
+ * the process halts.
+ */
+void
+vbe_release(int32_t pid)
+{
+    if (owner_pid < 0 || owner_pid != pid) {
+        return;
+    }
+
+    if (displayed) {
+        vbe_hide();
+    }
+    owner_pid = -1;
+    owner_terminal = -1;
+}
+
+/*
+ * Called when the displayed terminal changes. The graphics
+ * mode is only on screen while its owner's terminal is.
+ */
+void
+vbe_update_display(int32_t terminal)
+{
+    if (owner_pid < 0) {
+        return;
+    }
+
+    if (terminal == owner_terminal && !displayed) {
+        vbe_show();
+    } else if (terminal != owner_terminal && displayed) {
+        vbe_hide();
+    }
+}
+
+/*
+ * Detects the Bochs/QEMU VBE adapter and maps its frame
+ * buffer. Must be called after paging is enabled. If there
+ * is no adapter, the graphics syscalls just fail.
+ */
+void
+vbe_init(void)
+{
+    uint16_t id = vbe_read_register(VBE_REG_ID);
+    if (id < VBE_ID2 || id > VBE_ID5) {
+        debugf("No VBE adapter found (ID = 0x%x)\n", id);
+        return;
+    }
+
+    int32_t dev = pci_find_device(VBE_PCI_VENDOR, VBE_PCI_DEVICE);
+    if (dev < 0) {
+        debugf("VBE adapter not found on PCI bus\n");
+        return;
+    }
+
+    uint32_t addr = pci_read_config(0, dev, 0, PCI_REG_BAR0) & ~PCI_BAR_MEM_FLAGS;
+    if (!paging_map_framebuffer(addr, VBE_MAP_SIZE)) {
+        debugf("Could not map frame buffer at 0x%#x\n", addr);
+        return;
+    }
+
+    vbe_lfb = (uint8_t *)addr;
+    vbe_present = true;
+}
+
+/*
+ * set_video_mode() syscall handler. Switches the calling
+ * process's terminal to a width x height, 32bpp graphics
+ * mode, or back to text mode if both are 0. Only one process
+ * may use graphics at a time. The mode is automatically
+ * released when the process halts.
+ */
+__cdecl int32_t
+vbe_set_mode(uint32_t width, uint32_t height, uint32_t flags)
+{
+    pcb_t *pcb = get_executing_pcb();
+
+    if (!vbe_present) {
+        return -1;
+    }
+
+    /* Someone else has the display */
+    if (owner_pid >= 0 && owner_pid != pcb->pid) {
+        return -1;
+    }
+
+    /* Back to text mode */
+    if (width == 0 && height == 0) {
+        vbe_release(pcb->pid);
+        return 0;
+    }
+
+    /* The CRTC counts the width in units of 8 pixels */
+    if (width == 0 || width > VBE_MAX_WIDTH || (width & 7) != 0) {
+        return -1;
+    }
+    if (height == 0 || height > VBE_MAX_HEIGHT) {
+        return -1;
+    }
+    if ((flags & ~VBE_MODE_DOUBLE_BUFFER) != 0) {
+        return -1;
+    }
+
+    /* Drop any previous mode first */
+    vbe_release(pcb->pid);
+
+    mode_width = width;
+    mode_height = height;
+    mode_flags = flags;
+    first_row = (VBE_TEXT_RESERVE + vbe_pitch() - 1) / vbe_pitch();
+    front_page = 0;
+    back_page = (flags & VBE_MODE_DOUBLE_BUFFER) ? 1 : 0;
+    dirty.x0 = dirty.x1 = 0;
+    dirty.y0 = dirty.y1 = 0;
+
+    /* Both pages must fit in the mapped frame buffer */
+    int32_t end_row = vbe_page_row(back_page + 1);
+    ASSERT(end_row * vbe_pitch() <= VBE_MAP_SIZE);
+
+    /* Start with a black screen */
+    memset(vbe_pixel(0, 0, 0), 0, (end_row - first_row) * vbe_pitch());
+
+    owner_pid = pcb->pid;
+    owner_terminal = pcb->terminal;
+    vbe_update_display(get_display_terminal_index());
+    return 0;
+}
+
+/*
+ * blit() syscall handler. Copies a w x h block of 32-bit
+ * pixels from pixels to the rectangle rect of the back page.
+ * If flags has VBE_BLIT_PRESENT set, the back page is then
+ * shown. rect may be NULL to just present. In single-buffered
+ * modes, drawing goes straight to the screen and presenting
+ * does nothing.
+ */
+__cdecl int32_t
+vbe_blit(const uint32_t *pixels, const vbe_rect_t *rect, uint32_t flags)
+{
+    pcb_t *pcb = get_executing_pcb();
+
+    if (owner_pid < 0 || owner_pid != pcb->pid) {
+        return -1;
+    }
+    if ((flags & ~VBE_BLIT_PRESENT) != 0) {
+        return -1;
+    }
+
+    if (rect != NULL) {
+        if (!is_user_readable(rect, sizeof(vbe_rect_t))) {
+            return -1;
+        }
+
+        /* Copy the rectangle so it can't change under us */
+        vbe_rect_t r = *rect;
+        if (r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0 ||
+            r.w > mode_width - r.x || r.h > mode_height - r.y) {
+            return -1;
+        }
+
+        int32_t row_bytes = r.w * BYTES_PER_PIXEL;
+        if (!is_user_readable(pixels, row_bytes * r.h)) {
+            return -1;
+        }
+
+        int32_t y;
+        for (y = 0; y < r.h; ++y) {
+            memcpy(vbe_pixel(back_page, r.x, r.y + y), &pixels[y * r.w], row_bytes);
+        }
+
+        if (mode_flags & VBE_MODE_DOUBLE_BUFFER) {
+            vbe_mark_dirty(r.x, r.y, r.w, r.h);
+        }
+    }
+
+    if ((flags & VBE_BLIT_PRESENT) && (mode_flags & VBE_MODE_DOUBLE_BUFFER)) {
+        vbe_flip();
+    }
+
+    return 0;
+}
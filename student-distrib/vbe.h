@@ -0,0 +1,82 @@
+#ifndef _VBE_H
+#define _VBE_H
+
+#include "types.h"
+#include "syscall.h"
+
+/* Bochs/QEMU VBE (DISPI) interface ports */
+#define VBE_PORT_INDEX 0x1CE
+#define VBE_PORT_DATA  0x1CF
+
+/* DISPI register indices */
+#define VBE_REG_ID          0x0
+#define VBE_REG_XRES        0x1
+#define VBE_REG_YRES        0x2
+#define VBE_REG_BPP         0x3
+#define VBE_REG_ENABLE      0x4
+#define VBE_REG_BANK        0x5
+#define VBE_REG_VIRT_WIDTH  0x6
+#define VBE_REG_VIRT_HEIGHT 0x7
+#define VBE_REG_X_OFFSET    0x8
+#define VBE_REG_Y_OFFSET    0x9
+
+/* DISPI versions; we need at least ID2 for a linear frame buffer */
+#define VBE_ID2 0xB0C2
+#define VBE_ID5 0xB0C5
+
+/* Bits in the enable register */
+#define VBE_ENABLED     0x01
+#define VBE_LFB_ENABLED 0x40
+#define VBE_NOCLEARMEM  0x80
+
+/* PCI IDs of the emulated VGA adapter */
+#define VBE_PCI_VENDOR 0x1234
+#define VBE_PCI_DEVICE 0x1111
+
+/* Limits for the modes we allow */
+#define VBE_BPP        32
+#define VBE_MAX_WIDTH  1024
+#define VBE_MAX_HEIGHT 768
+
+/*
+ * Amount of video memory to leave alone at the start of the
+ * frame buffer. The text mode screens and font live here, and
+ * need to survive until we switch back.
+ */
+#define VBE_TEXT_RESERVE 0x40000
+
+/* Amount of the frame buffer that we map */
+#define VBE_MAP_SIZE 0x800000
+
+/* Flags for vbe_set_mode */
+#define VBE_MODE_DOUBLE_BUFFER 0x1
+
+/* Flags for vbe_blit */
+#define VBE_BLIT_PRESENT 0x1
+
+#ifndef ASM
+
+/* Rectangle passed to vbe_blit */
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+} vbe_rect_t;
+
+/* Releases the display if it is owned by the specified process */
+void vbe_release(int32_t pid);
+
+/* Shows or hides the graphics mode when switching terminals */
+void vbe_update_display(int32_t terminal);
+
+/* Detects the VBE adapter and maps its frame buffer */
+void vbe_init(void);
+
+/* Direct syscall handlers */
+__cdecl int32_t vbe_set_mode(uint32_t width, uint32_t height, uint32_t flags);
+__cdecl int32_t vbe_blit(const uint32_t *pixels, const vbe_rect_t *rect, uint32_t flags);
+
+#endif /* ASM */
+
+#endif /* _VBE_H */
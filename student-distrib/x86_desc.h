@@ -10,10 +10,18 @@
 #define USER_DS 0x002B
 #define KERNEL_TSS 0x0030
 #define KERNEL_LDT 0x0038
+#define USER_TLS 0x0043
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE 104
 
+/*
+ * Number of I/O ports covered by the TSS I/O permission bitmap,
+ * which follows the TSS. Userspace can never reach ports above it.
+ */
+#define IO_BITMAP_PORTS 0x400
+#define IO_BITMAP_SIZE  (IO_BITMAP_PORTS / 8)
+
 /* Number of vectors in the interrupt descriptor table (IDT) */
 #define NUM_VEC 256
 
@@ -107,6 +115,13 @@ typedef struct __attribute__((packed)) tss_t {
     uint16_t debug_trap : 1;
     uint16_t io_pad : 15;
     uint16_t io_base_addr;
+
+    /*
+     * I/O permission bitmap (a set bit denies access to the
+     * port), and the all-ones byte the CPU expects after it.
+     */
+    uint8_t io_bitmap[IO_BITMAP_SIZE];
+    uint8_t io_bitmap_end;
 } tss_t;
 
 /* Some external descriptors declared in .S files */
@@ -122,6 +137,8 @@ extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
 
+extern seg_desc_t tls_desc_ptr;
+
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim) \
 do { \
@@ -142,6 +159,14 @@ do { \
         str.seg_lim_15_00 = (lim) & 0x0000FFFF; \
 } while(0)
 
+/* Sets the base of the user TLS segment (loaded into GS) */
+#define SET_TLS_BASE(str, addr) \
+do { \
+    str.base_31_24 = ((uint32_t)(addr) & 0xFF000000) >> 24; \
+        str.base_23_16 = ((uint32_t)(addr) & 0x00FF0000) >> 16; \
+        str.base_15_00 = (uint32_t)(addr) & 0x0000FFFF; \
+} while(0)
+
 /* An interrupt descriptor entry (goes into the IDT) */
 typedef union idt_desc_t {
     uint32_t val[2];
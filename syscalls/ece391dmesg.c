@@ -0,0 +1,28 @@
+#include <stdint.h>
+
+#include "ece391support.h"
+#include "ece391syscall.h"
+
+#define BUFSIZE 1024
+
+int main ()
+{
+    int32_t fd, cnt;
+    uint8_t buf[BUFSIZE];
+
+    if (-1 == (fd = ece391_open ((uint8_t*)"klog"))) {
+        ece391_fdputs (1, (uint8_t*)"could not open kernel log\n");
+        return 2;
+    }
+
+    while (0 != (cnt = ece391_read (fd, buf, BUFSIZE))) {
+        if (-1 == cnt) {
+            ece391_fdputs (1, (uint8_t*)"kernel log read failed\n");
+            return 3;
+        }
+        if (-1 == ece391_write (1, buf, cnt))
+            return 3;
+    }
+
+    return 0;
+}
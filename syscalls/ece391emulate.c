@@ -1,71 +1,404 @@
+/*
+ * Emulation of the ECE391 system calls on Linux. Linking a program
+ * against this file instead of the system call library lets it run
+ * as an ordinary Linux process, where it can be debugged and profiled
+ * with the host's tools (gdb, perf, valgrind) before it ever runs in
+ * the guest.
+ *
+ * The devices are stood in for as follows:
+ *
+ *   rtc     - a timerfd, reprogrammed by writes to the file
+ *   mouse   - packets read from the script named by ECE391_MOUSE
+ *             (see mouse_load_script below); without one, the mouse
+ *             never moves
+ *   vidmap  - a 4kB text screen in shared memory; if ECE391_SCREEN
+ *             names a file, the screen is mapped from it so another
+ *             process can watch it
+ *   video   - set_video_mode and blit draw into memory, which is
+ *             mapped from ECE391_FRAMEBUF in the same way
+ *   signals - DIV_ZERO, SEGFAULT, INTERRUPT, ALARM and USER1 are
+ *             SIGFPE, SIGSEGV, SIGINT, SIGALRM and SIGUSR1
+ *   set_tls - always fails, since the C library owns GS
+ *   ioperm  - the host's ioperm, so it only works as root; there is
+ *             no "irq" device
+ *
+ * Every call is counted and timed. If ECE391_STATS is set, a table
+ * of the counts, failures and time spent in each call is written to
+ * stderr when the program halts.
+ */
+
 #include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <sys/wait.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/io.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "ece391support.h"
 #include "ece391syscall.h"
 #include "ece391sysnum.h"
 
+#define NUM_SYSCALLS     SYS_IOPERM
+#define MAX_FILES        64
+#define SCREEN_SIZE      4096
+#define SCREEN_COLS      80
+#define SCREEN_ROWS      25
+#define MAX_VIDEO_WIDTH  1024
+#define MAX_VIDEO_HEIGHT 768
+#define RTC_DEFAULT_FREQ 2
+#define RTC_MAX_FREQ     1024
+#define ALARM_PERIOD     10
+#define TICKS_PER_SEC    1000
+#define MOUSE_MAX_EVENTS 4096
+
+/* Mouse packet, as the kernel's mouse driver returns them */
+#define MOUSE_LEFT   0x01
+#define MOUSE_RIGHT  0x02
+#define MOUSE_MIDDLE 0x04
+#define MOUSE_ALWAYS 0x08
+
+typedef struct {
+    uint8_t flags;
+    int8_t dx;
+    int8_t dy;
+} mouse_input_t;
+
+/* What each open Linux file descriptor stands for */
+typedef enum {
+    EMU_FILE = 0,
+    EMU_DIR,
+    EMU_RTC,
+    EMU_MOUSE
+} file_type_t;
+
+typedef struct {
+    file_type_t type;
+    DIR* dir;
+} emu_file_t;
+
+/* Per-syscall statistics */
+typedef struct {
+    const char* name;
+    uint32_t calls;
+    uint32_t failures;
+    uint64_t ns;
+} syscall_stats_t;
 
 static uint32_t start_esp;
-static int32_t dir_fd = -1;
-static DIR* dir = NULL;
+static struct timespec start_time;
+static emu_file_t files[MAX_FILES];
 
+static syscall_stats_t stats[NUM_SYSCALLS + 1] = {
+    [SYS_HALT]           = { "halt" },
+    [SYS_EXECUTE]        = { "execute" },
+    [SYS_READ]           = { "read" },
+    [SYS_WRITE]          = { "write" },
+    [SYS_OPEN]           = { "open" },
+    [SYS_CLOSE]          = { "close" },
+    [SYS_GETARGS]        = { "getargs" },
+    [SYS_VIDMAP]         = { "vidmap" },
+    [SYS_SET_HANDLER]    = { "set_handler" },
+    [SYS_SIGRETURN]      = { "sigreturn" },
+    [SYS_SET_VIDEO_MODE] = { "set_video_mode" },
+    [SYS_BLIT]           = { "blit" },
+    [SYS_VIDMAP_BUFFERED] = { "vidmap_buffered" },
+    [SYS_PRESENT]        = { "present" },
+    [SYS_CELL_BLIT]      = { "cell_blit" },
+    [SYS_TIMES]          = { "times" },
+    [SYS_SET_TLS]        = { "set_tls" },
+    [SYS_IOPERM]         = { "ioperm" },
+};
 
-/* 
- * (copied from the real system call support)
- *
- * Rather than create a case for each number of arguments, we simplify
- * and use one macro for up to three arguments; the system calls should
- * ignore the other registers, and they're caller-saved anyway.
- */
-#define DO_CALL(name,number)       \
-asm volatile ("                    \
-.GLOBL " #name "                  ;\
-" #name ":                        ;\
-        PUSHL	%EBX              ;\
-	MOVL	$" #number ",%EAX ;\
-	MOVL	8(%ESP),%EBX      ;\
-	MOVL	12(%ESP),%ECX     ;\
-	MOVL	16(%ESP),%EDX     ;\
-	INT	$0x80             ;\
-	CMP	$0xFFFFC000,%EAX  ;\
-	JBE	1f                ;\
-	MOVL	$-1,%EAX	  ;\
-1:	POPL	%EBX              ;\
-	RET                        \
-")
-
-/* these wrappers require no changes */
-extern int32_t __ece391_read (int32_t fd, void* buf, int32_t nbytes);
-extern int32_t __ece391_write (int32_t fd, const void* buf, int32_t nbytes);
-extern int32_t __ece391_close (int32_t fd);
-void fake_function () {
-DO_CALL(ece391_halt,1 /* SYS_HALT */);
-DO_CALL(__ece391_read,3 /* SYS_READ */);
-DO_CALL(__ece391_write,4 /* SYS_WRITE */);
-DO_CALL(__ece391_close,6 /* SYS_CLOSE */);
+/* Text screen; the back buffer only exists after vidmap_buffered */
+static uint8_t* screen = NULL;
+static uint8_t* back_screen = NULL;
+
+/* Graphics mode; back_pixels == pixels unless double buffered */
+static uint32_t* pixels = NULL;
+static uint32_t* back_pixels = NULL;
+static uint32_t video_width, video_height, video_flags;
+
+/* Mouse script, and how far through it the program has read */
+static mouse_input_t* mouse_events = NULL;
+static uint8_t* mouse_breaks = NULL;
+static int32_t mouse_count = -1;
+static int32_t mouse_pos = 0;
+
+/* Signal handlers set by the program */
+static void (*handlers[NUM_SIGNALS]) (int32_t signum);
+static const int host_signals[NUM_SIGNALS] = {
+    [DIV_ZERO]  = SIGFPE,
+    [SEGFAULT]  = SIGSEGV,
+    [INTERRUPT] = SIGINT,
+    [ALARM]     = SIGALRM,
+    [USER1]     = SIGUSR1,
+};
 
-/* Call the main() function, then halt with its return value. */
 
-asm volatile ("                         \n\
+/* Call the main() function, then halt with its return value. */
+asm ("                                  \n\
+.TEXT                                   \n\
 .GLOBAL _start                          \n\
 _start:                                 \n\
 	MOVL	%ESP,start_esp          \n\
+	CALL	emulate_init            \n\
         CALL	main                    \n\
 	PUSHL	%EAX                    \n\
+	CALL	ece391_flush            \n\
 	CALL	ece391_halt             \n\
 ");
 
-/* end of fake container function */
+
+static uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
-int32_t 
-ece391_execute (const uint8_t* command)
+/* Records one call to syscall num, and passes its return value on. */
+static int32_t
+account (int32_t num, uint64_t start, int32_t rval)
+{
+    stats[num].calls++;
+    stats[num].ns += now_ns () - start;
+    if (-1 == rval)
+        stats[num].failures++;
+    return rval;
+}
+
+static void
+print_stats (void)
+{
+    int32_t argc = *(uint32_t*)start_esp;
+    char** argv = (char**)(start_esp + 4);
+    int32_t num;
+
+    if (NULL == getenv ("ECE391_STATS"))
+        return;
+    fprintf (stderr, "\n%s: system call statistics\n", 0 < argc ? argv[0] : "?");
+    fprintf (stderr, "%-16s %10s %10s %14s %12s\n",
+             "syscall", "calls", "failures", "total (us)", "avg (ns)");
+    for (num = 1; num <= NUM_SYSCALLS; num++) {
+        if (0 == stats[num].calls)
+            continue;
+        fprintf (stderr, "%-16s %10u %10u %14.1f %12llu\n", stats[num].name,
+                 stats[num].calls, stats[num].failures, stats[num].ns / 1000.0,
+                 (unsigned long long)(stats[num].ns / stats[num].calls));
+    }
+}
+
+/*
+ * Maps size bytes of zeroed, shared memory, backed by the file named
+ * by the environment variable env if it's set.
+ */
+static void*
+map_shared (const char* env, size_t size)
+{
+    const char* path = getenv (env);
+    void* mem;
+    int fd;
+
+    if (NULL == path)
+        mem = mmap (NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    else {
+        if (-1 == (fd = open (path, O_RDWR | O_CREAT, 0644)))
+            return NULL;
+        if (0 != ftruncate (fd, 0) || 0 != ftruncate (fd, size)) {
+            (void)close (fd);
+            return NULL;
+        }
+        mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        (void)close (fd);
+    }
+    return MAP_FAILED == mem ? NULL : mem;
+}
+
+static file_type_t
+file_type (int32_t fd)
+{
+    if (fd < 0 || fd >= MAX_FILES)
+        return EMU_FILE;
+    return files[fd].type;
+}
+
+/* Runs before main() */
+void
+emulate_init (void)
+{
+    (void)clock_gettime (CLOCK_MONOTONIC, &start_time);
+    /* Like the kernel, only the signals a program handles interrupt it */
+    (void)signal (SIGALRM, SIG_IGN);
+    (void)signal (SIGUSR1, SIG_IGN);
+}
+
+
+/*
+ * Mouse scripts are text files with one packet per line,
+ *
+ *     dx dy [buttons]
+ *
+ * where buttons is any of L, R and M. A line holding only "-" ends a
+ * batch: a read returns the packets up to the next break, and the read
+ * after that returns 0, just as if the program had drained the real
+ * mouse buffer. Once the script runs out, reads always return 0. Blank
+ * lines and lines starting with '#' are ignored.
+ */
+static int32_t
+mouse_load_script (void)
+{
+    const char* path = getenv ("ECE391_MOUSE");
+    char line[128];
+    FILE* f;
+    int dx, dy, n;
+    char buttons[8];
+    mouse_input_t* ev;
+
+    mouse_count = 0;
+    mouse_events = calloc (MOUSE_MAX_EVENTS, sizeof (mouse_input_t));
+    mouse_breaks = calloc (MOUSE_MAX_EVENTS + 1, 1);
+    if (NULL == mouse_events || NULL == mouse_breaks)
+        return -1;
+    if (NULL == path)
+        return 0;
+    if (NULL == (f = fopen (path, "r")))
+        return -1;
+
+    while (NULL != fgets (line, sizeof (line), f) &&
+           MOUSE_MAX_EVENTS > mouse_count) {
+        if ('-' == line[0] && ('\n' == line[1] || '\0' == line[1])) {
+            mouse_breaks[mouse_count] = 1;
+            continue;
+        }
+        buttons[0] = '\0';
+        if ('#' == line[0] ||
+            2 > (n = sscanf (line, "%d %d %7s", &dx, &dy, buttons)))
+            continue;
+        ev = &mouse_events[mouse_count++];
+        ev->flags = MOUSE_ALWAYS;
+        ev->flags |= strchr (buttons, 'L') ? MOUSE_LEFT : 0;
+        ev->flags |= strchr (buttons, 'R') ? MOUSE_RIGHT : 0;
+        ev->flags |= strchr (buttons, 'M') ? MOUSE_MIDDLE : 0;
+        ev->dx = dx < -128 ? -128 : (dx > 127 ? 127 : dx);
+        ev->dy = dy < -128 ? -128 : (dy > 127 ? 127 : dy);
+    }
+    (void)fclose (f);
+    return 0;
+}
+
+static int32_t
+mouse_read (uint8_t* buf, int32_t nbytes)
+{
+    int32_t copied = 0;
+
+    if (mouse_breaks[mouse_pos]) {
+        mouse_breaks[mouse_pos] = 0;
+        return 0;
+    }
+    /* Only whole packets are returned */
+    while (mouse_pos < mouse_count && !mouse_breaks[mouse_pos] &&
+           nbytes - copied >= (int32_t)sizeof (mouse_input_t)) {
+        memcpy (buf + copied, &mouse_events[mouse_pos++], sizeof (mouse_input_t));
+        copied += sizeof (mouse_input_t);
+    }
+    return copied;
+}
+
+static int32_t
+rtc_set_freq (int fd, int32_t freq)
+{
+    struct itimerspec its;
+
+    if (freq < RTC_DEFAULT_FREQ || freq > RTC_MAX_FREQ || 0 != (freq & (freq - 1)))
+        return -1;
+    its.it_interval.tv_sec = 0;
+    its.it_interval.tv_nsec = 1000000000L / freq;
+    its.it_value = its.it_interval;
+    return timerfd_settime (fd, 0, &its, NULL);
+}
+
+/*
+ * Like the kernel's, waits for the next tick, not one that already
+ * happened while the program was busy. Returns -1 if a signal came in.
+ */
+static int32_t
+rtc_read (int fd)
+{
+    struct pollfd pfd;
+    uint64_t expirations;
+
+    while (sizeof (expirations) == read (fd, &expirations, sizeof (expirations)));
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (1 != poll (&pfd, 1, -1))
+        return -1;
+    (void)read (fd, &expirations, sizeof (expirations));
+    return 0;
+}
+
+
+/* Translates the host signal, then calls the program's handler. */
+static void
+signal_trampoline (int host_signum)
+{
+    int32_t signum;
+
+    for (signum = 0; NUM_SIGNALS > signum; signum++) {
+        if (host_signals[signum] == host_signum && NULL != handlers[signum]) {
+            handlers[signum] (signum);
+            return;
+        }
+    }
+}
+
+static int32_t
+emu_set_handler (int32_t signum, void* handler)
+{
+    struct sigaction sa;
+    struct itimerval alarm;
+
+    if (0 > signum || NUM_SIGNALS <= signum)
+        return -1;
+    handlers[signum] = handler;
+
+    /* No SA_RESTART, so blocking calls fail like they do in the kernel */
+    memset (&sa, 0, sizeof (sa));
+    sigemptyset (&sa.sa_mask);
+    if (NULL != handler)
+        sa.sa_handler = signal_trampoline;
+    else if (ALARM == signum || USER1 == signum)
+        sa.sa_handler = SIG_IGN;
+    else
+        sa.sa_handler = SIG_DFL;
+    if (0 != sigaction (host_signals[signum], &sa, NULL))
+        return -1;
+
+    /* The kernel sends ALARM every ALARM_PERIOD seconds */
+    if (ALARM == signum && NULL != handler) {
+        alarm.it_interval.tv_sec = ALARM_PERIOD;
+        alarm.it_interval.tv_usec = 0;
+        alarm.it_value = alarm.it_interval;
+        (void)setitimer (ITIMER_REAL, &alarm, NULL);
+    }
+    return 0;
+}
+
+static int32_t
+emu_execute (const uint8_t* command)
 {
     int status;
     uint8_t buf[1026];
@@ -78,7 +411,7 @@ ece391_execute (const uint8_t* command)
     buf[0] = '.';
     buf[1] = '/';
     ece391_strcpy (buf + 2, command);
-    for (scan = buf + 2; '\0' != *scan && ' ' != *scan && '\n' != *scan; 
+    for (scan = buf + 2; '\0' != *scan && ' ' != *scan && '\n' != *scan;
          scan++);
     args[0] = (char*)buf;
     n_arg = 1;
@@ -98,11 +431,12 @@ ece391_execute (const uint8_t* command)
 	}
     }
     args[n_arg] = NULL;
+    (void)ece391_flush ();
     if (0 == fork ()) {
 	execv ((char*)buf, args);
         kill (getpid (), 9);
     }
-    (void)wait (&status);
+    while (-1 == wait (&status) && EINTR == errno);
     if (WIFEXITED (status))
         return WEXITSTATUS (status);
     if (9 == WTERMSIG (status))
@@ -110,26 +444,50 @@ ece391_execute (const uint8_t* command)
     return 256;
 }
 
-int32_t 
-ece391_open (const uint8_t* filename)
+static int32_t
+emu_open (const uint8_t* filename)
 {
-    uint32_t rval;
+    file_type_t type = EMU_FILE;
+    DIR* dir = NULL;
+    int fd;
 
     if (0 == ece391_strcmp (filename, (uint8_t*)".")) {
-	dir = opendir (".");
-        dir_fd = open ("/dev/null", O_RDONLY);
-	return dir_fd;
+        if (NULL == (dir = opendir (".")))
+            return -1;
+        fd = dirfd (dir);
+        type = EMU_DIR;
+    } else if (0 == ece391_strcmp (filename, (uint8_t*)"rtc")) {
+        fd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if (-1 != fd && 0 != rtc_set_freq (fd, RTC_DEFAULT_FREQ)) {
+            (void)close (fd);
+            fd = -1;
+        }
+        type = EMU_RTC;
+    } else if (0 == ece391_strcmp (filename, (uint8_t*)"mouse")) {
+        if (-1 == mouse_count && 0 != mouse_load_script ())
+            return -1;
+        fd = open ("/dev/null", O_RDONLY);
+        type = EMU_MOUSE;
+    } else {
+        fd = open ((const char*)filename, O_RDONLY);
     }
 
-    asm volatile ("INT $0x80" : "=a" (rval) :
-		  "a" (5), "b" (filename), "c" (O_RDONLY));
-    if (rval > 0xFFFFC000)
+    if (-1 == fd)
         return -1;
-    return rval;
+    if (MAX_FILES <= fd) {
+        if (NULL != dir)
+            (void)closedir (dir);
+        else
+            (void)close (fd);
+        return -1;
+    }
+    files[fd].type = type;
+    files[fd].dir = dir;
+    return fd;
 }
 
-int32_t 
-ece391_getargs (uint8_t* buf, int32_t nbytes)
+static int32_t
+emu_getargs (uint8_t* buf, int32_t nbytes)
 {
     int32_t argc = *(uint32_t*)start_esp;
     uint8_t** argv = (uint8_t**)(start_esp + 4);
@@ -156,37 +514,172 @@ ece391_getargs (uint8_t* buf, int32_t nbytes)
     return 0;
 }
 
-int32_t 
-ece391_vidmap (uint8_t** screen_start)
+static int32_t
+emu_vidmap (uint8_t** screen_start)
 {
-    static int mem_fd = -1;
-    void* mem_image;
+    if (NULL == screen_start)
+        return -1;
+    if (NULL == screen && NULL == (screen = map_shared ("ECE391_SCREEN", SCREEN_SIZE)))
+        return -1;
+    *screen_start = screen;
+    return 0;
+}
+
+static int32_t
+emu_vidmap_buffered (uint8_t** screen_start)
+{
+    uint8_t* front;
 
-    if(mem_fd == -1) {
-        mem_fd = open ("/dev/mem", O_RDWR);
+    if (NULL == screen_start || 0 != emu_vidmap (&front))
+        return -1;
+    if (NULL == back_screen) {
+        if (NULL == (back_screen = malloc (SCREEN_SIZE)))
+            return -1;
+        memcpy (back_screen, front, SCREEN_SIZE);
     }
+    *screen_start = back_screen;
+    return 0;
+}
 
-    if ((mem_image = mmap((void*)0, 1024*1024, PROT_READ | PROT_WRITE,
-                    MAP_SHARED, mem_fd, 0)) == MAP_FAILED) {
-        perror ("mmap low memory");
+/* There's no vertical retrace to wait for, so this just copies. */
+static int32_t
+emu_present (void)
+{
+    if (NULL == back_screen)
+        return -1;
+    memcpy (screen, back_screen, SCREEN_SIZE);
+    return 0;
+}
+
+static int32_t
+emu_cell_blit (const uint16_t* cells, const blit_rect_t* rect)
+{
+    blit_rect_t r;
+    uint8_t* dest;
+    int32_t y;
+
+    if (NULL == rect || NULL == cells || 0 != emu_vidmap (&dest))
+        return -1;
+    r = *rect;
+    if (r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0 ||
+        r.w > SCREEN_COLS - r.x || r.h > SCREEN_ROWS - r.y)
+        return -1;
+    for (y = 0; y < r.h; y++)
+        memcpy (dest + ((r.y + y) * SCREEN_COLS + r.x) * 2, &cells[y * r.w],
+                r.w * sizeof (uint16_t));
+    return 0;
+}
+
+static void
+video_release (void)
+{
+    size_t size = video_width * video_height * sizeof (uint32_t);
+
+    if (NULL != back_pixels && back_pixels != pixels)
+        free (back_pixels);
+    if (NULL != pixels)
+        (void)munmap (pixels, size);
+    pixels = back_pixels = NULL;
+    video_width = video_height = video_flags = 0;
+}
+
+static int32_t
+emu_set_video_mode (uint32_t width, uint32_t height, uint32_t flags)
+{
+    size_t size = width * height * sizeof (uint32_t);
+
+    video_release ();
+    if (0 == width && 0 == height)
+        return 0;
+    if (0 == width || MAX_VIDEO_WIDTH < width || 0 != (width & 7) ||
+        0 == height || MAX_VIDEO_HEIGHT < height ||
+        0 != (flags & ~VIDEO_MODE_DOUBLE_BUFFER))
+        return -1;
+
+    if (NULL == (pixels = map_shared ("ECE391_FRAMEBUF", size)))
+        return -1;
+    back_pixels = pixels;
+    if (0 != (flags & VIDEO_MODE_DOUBLE_BUFFER) &&
+        NULL == (back_pixels = calloc (1, size))) {
+        (void)munmap (pixels, size);
+        pixels = NULL;
         return -1;
     }
+    video_width = width;
+    video_height = height;
+    video_flags = flags;
+    return 0;
+}
 
-    *screen_start = (uint8_t*)(mem_image + 0xb8000);
+static int32_t
+emu_blit (const uint32_t* src, const blit_rect_t* rect, uint32_t flags)
+{
+    blit_rect_t r;
+    int32_t y;
+
+    if (NULL == pixels || 0 != (flags & ~BLIT_PRESENT))
+        return -1;
+    if (NULL != rect) {
+        r = *rect;
+        if (NULL == src || r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0 ||
+            r.w > (int32_t)video_width - r.x || r.h > (int32_t)video_height - r.y)
+            return -1;
+        for (y = 0; y < r.h; y++)
+            memcpy (&back_pixels[(r.y + y) * video_width + r.x], &src[y * r.w],
+                    r.w * sizeof (uint32_t));
+    }
+    if (0 != (flags & BLIT_PRESENT) && back_pixels != pixels)
+        memcpy (pixels, back_pixels, video_width * video_height * sizeof (uint32_t));
     return 0;
 }
 
-int32_t 
-ece391_read (int32_t fd, void* buf, int32_t nbytes)
+static uint32_t
+to_ticks (struct timeval tv)
+{
+    return tv.tv_sec * TICKS_PER_SEC + tv.tv_usec / (1000000 / TICKS_PER_SEC);
+}
+
+/* Emulator startup stands in for boot */
+static int32_t
+emu_times (times_t* buf)
+{
+    struct rusage self, children;
+    uint64_t ns;
+
+    if (NULL == buf ||
+        0 != getrusage (RUSAGE_SELF, &self) ||
+        0 != getrusage (RUSAGE_CHILDREN, &children))
+        return -1;
+    ns = now_ns () - ((uint64_t)start_time.tv_sec * 1000000000ULL + start_time.tv_nsec);
+    buf->elapsed = ns / (1000000000ULL / TICKS_PER_SEC);
+    buf->cpu = to_ticks (self.ru_utime) + to_ticks (self.ru_stime);
+    buf->child_cpu = to_ticks (children.ru_utime) + to_ticks (children.ru_stime);
+    buf->ticks_per_sec = TICKS_PER_SEC;
+    return 0;
+}
+
+static int32_t
+emu_read (int32_t fd, void* buf, int32_t nbytes)
 {
     struct dirent* de;
     int32_t copied;
     uint8_t* from;
     uint8_t* to;
 
-    if (NULL == dir || dir_fd != fd)
-        return __ece391_read (fd, buf, nbytes);
-    if (NULL == (de = readdir (dir)))
+    if (NULL == buf || 0 > nbytes)
+        return -1;
+    switch (file_type (fd)) {
+    case EMU_RTC:
+        return rtc_read (fd);
+    case EMU_MOUSE:
+        return mouse_read (buf, nbytes);
+    case EMU_FILE:
+        return read (fd, buf, nbytes);
+    case EMU_DIR:
+        break;
+    }
+
+    if (NULL == (de = readdir (files[fd].dir)))
         return 0;
     to = buf;
     from = (uint8_t*)de->d_name;
@@ -205,23 +698,172 @@ ece391_read (int32_t fd, void* buf, int32_t nbytes)
     return copied;
 }
 
-int32_t 
+static int32_t
+emu_write (int32_t fd, const void* buf, int32_t nbytes)
+{
+    if (NULL == buf || 0 > nbytes)
+        return -1;
+    switch (file_type (fd)) {
+    case EMU_RTC:
+        if (sizeof (int32_t) != nbytes)
+            return -1;
+        return rtc_set_freq (fd, *(const int32_t*)buf);
+    case EMU_FILE:
+        return write (fd, buf, nbytes);
+    default:
+        return -1;
+    }
+}
+
+static int32_t
+emu_close (int32_t fd)
+{
+    /* Like the kernel, don't let stdin and stdout be closed */
+    if (2 > fd)
+        return -1;
+    if (EMU_DIR == file_type (fd)) {
+        files[fd].type = EMU_FILE;
+        (void)closedir (files[fd].dir);
+        files[fd].dir = NULL;
+        return 0;
+    }
+    if (fd < MAX_FILES)
+        files[fd].type = EMU_FILE;
+    return close (fd);
+}
+
+
+/* The system calls themselves: each one is counted and timed. */
+
+int32_t
+ece391_halt (uint8_t status)
+{
+    uint64_t start = now_ns ();
+
+    (void)account (SYS_HALT, start, 0);
+    print_stats ();
+    fflush (NULL);
+    _exit (status);
+}
+
+int32_t
+ece391_execute (const uint8_t* command)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_EXECUTE, start, emu_execute (command));
+}
+
+int32_t
+ece391_read (int32_t fd, void* buf, int32_t nbytes)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_READ, start, emu_read (fd, buf, nbytes));
+}
+
+int32_t
 ece391_write (int32_t fd, const void* buf, int32_t nbytes)
 {
-    if (NULL == dir || dir_fd != fd)
-        return __ece391_write (fd, buf, nbytes);
-    return -1;
+    uint64_t start = now_ns ();
+    return account (SYS_WRITE, start, emu_write (fd, buf, nbytes));
 }
 
-int32_t 
+int32_t
+ece391_open (const uint8_t* filename)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_OPEN, start, emu_open (filename));
+}
+
+int32_t
 ece391_close (int32_t fd)
 {
-    if (NULL == dir || dir_fd != fd)
-        return __ece391_close (fd);
-    (void)closedir (dir);
-    dir = NULL;
-    (void)close (dir_fd);
-    dir_fd = -1;
-    return 0;
+    uint64_t start = now_ns ();
+    return account (SYS_CLOSE, start, emu_close (fd));
+}
+
+int32_t
+ece391_getargs (uint8_t* buf, int32_t nbytes)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_GETARGS, start, emu_getargs (buf, nbytes));
+}
+
+int32_t
+ece391_vidmap (uint8_t** screen_start)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_VIDMAP, start, emu_vidmap (screen_start));
+}
+
+int32_t
+ece391_set_handler (int32_t signum, void* handler)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_SET_HANDLER, start, emu_set_handler (signum, handler));
+}
+
+/* Handlers return through the host's sigreturn, so this has nothing to do */
+int32_t
+ece391_sigreturn (void)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_SIGRETURN, start, 0);
+}
+
+int32_t
+ece391_set_video_mode (uint32_t width, uint32_t height, uint32_t flags)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_SET_VIDEO_MODE, start,
+                    emu_set_video_mode (width, height, flags));
 }
 
+int32_t
+ece391_blit (const uint32_t* src, const blit_rect_t* rect, uint32_t flags)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_BLIT, start, emu_blit (src, rect, flags));
+}
+
+int32_t
+ece391_vidmap_buffered (uint8_t** screen_start)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_VIDMAP_BUFFERED, start, emu_vidmap_buffered (screen_start));
+}
+
+int32_t
+ece391_present (void)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_PRESENT, start, emu_present ());
+}
+
+int32_t
+ece391_cell_blit (const uint16_t* cells, const blit_rect_t* rect)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_CELL_BLIT, start, emu_cell_blit (cells, rect));
+}
+
+int32_t
+ece391_times (times_t* buf)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_TIMES, start, emu_times (buf));
+}
+
+/* The host's C library keeps its own thread pointer in GS */
+int32_t
+ece391_set_tls (void* base)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_SET_TLS, start, -1);
+}
+
+int32_t
+ece391_ioperm (uint32_t from, uint32_t num, int32_t turn_on)
+{
+    uint64_t start = now_ns ();
+    return account (SYS_IOPERM, start, 0 == ioperm (from, num, turn_on) ? 0 : -1);
+}
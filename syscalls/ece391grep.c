@@ -3,93 +3,248 @@
 #include "ece391support.h"
 #include "ece391syscall.h"
 
-#define BUFSIZE 1024
+/*
+ * Usage: grep [-c] [-m] [--] pattern[|pattern...]
+ *
+ * Prints every line of every file in the directory that contains
+ * any of the patterns (which may contain spaces). -c prints the
+ * number of matching lines in each file instead, and -m stops at
+ * the first matching line in each file.
+ */
+
+#define BUFSIZE 16384
+#define ARGSIZE 1024
 #define SBUFSIZE 33
+#define MAX_PATTERNS 8
+
+/* A search string, with its Boyer-Moore-Horspool skip table */
+typedef struct {
+    const uint8_t* str;
+    int32_t len;
+    int32_t skip[256];
+} pattern_t;
+
+static pattern_t patterns[MAX_PATTERNS];
+static int32_t num_patterns;
+static int32_t count_only;
+static int32_t first_only;
+
+/* File contents, plus the partial line carried over between reads */
+static uint8_t data[BUFSIZE];
+
+static void
+init_pattern (pattern_t* p, const uint8_t* str)
+{
+    int32_t i;
+
+    p->str = str;
+    p->len = ece391_strlen (str);
+    for (i = 0; i < 256; i++)
+        p->skip[i] = p->len;
+    for (i = 0; i < p->len - 1; i++)
+        p->skip[str[i]] = p->len - 1 - i;
+}
+
+/*
+ * Returns the offset of the first match of p in data[start, end),
+ * or -1 if there isn't one.
+ */
+static int32_t
+find_pattern (const pattern_t* p, int32_t start, int32_t end)
+{
+    const uint8_t* hit;
+    int32_t last = p->len - 1;
+    uint8_t c;
+    int32_t i;
+
+    if (start >= end)
+        return -1;
+
+    if (1 == p->len) {
+        hit = ece391_memchr (data + start, p->str[0], end - start);
+        return (0 == hit) ? -1 : hit - data;
+    }
+
+    while (start + last < end) {
+        c = data[start + last];
+        if (c == p->str[last]) {
+            for (i = 0; i < last && data[start + i] == p->str[i]; i++);
+            if (i == last)
+                return start;
+        }
+        start += p->skip[c];
+    }
+    return -1;
+}
+
+/*
+ * Searches the complete lines in data[0, end) and prints the
+ * matching ones. next[] caches the next match of each pattern,
+ * so each pattern only scans the buffer once. Returns the number
+ * of matching lines.
+ */
+static int32_t
+search_lines (const uint8_t* fname, int32_t end, int32_t max_matches)
+{
+    int32_t next[MAX_PATTERNS];
+    int32_t matches = 0;
+    int32_t pos = 0;
+    int32_t hit, line_start, line_end;
+    const uint8_t* nl;
+    int32_t i;
+
+    for (i = 0; i < num_patterns; i++)
+        next[i] = find_pattern (&patterns[i], 0, end);
+
+    while (matches < max_matches) {
+        /* Find the earliest match of any pattern */
+        hit = -1;
+        for (i = 0; i < num_patterns; i++)
+            if (-1 != next[i] && (-1 == hit || next[i] < hit))
+                hit = next[i];
+        if (-1 == hit)
+            break;
+
+        /* Find the line around it */
+        for (line_start = hit; line_start > pos && '\n' != data[line_start - 1];
+             line_start--);
+        nl = ece391_memchr (data + hit, '\n', end - hit);
+        line_end = (0 == nl) ? end : nl - data;
+
+        matches++;
+        if (!count_only) {
+            ece391_printf ("%s:", fname);
+            ece391_putbuf (data + line_start, line_end - line_start);
+            ece391_putc ('\n');
+        }
+
+        /* Patterns can't span lines, so skip the rest of this one */
+        pos = line_end + 1;
+        for (i = 0; i < num_patterns; i++)
+            if (-1 != next[i] && next[i] < pos)
+                next[i] = find_pattern (&patterns[i], pos, end);
+    }
+
+    return matches;
+}
 
 int32_t
-do_one_file (const char* s, const char* fname) 
+do_one_file (const uint8_t* fname)
 {
-    int32_t fd, cnt, last, line_start, line_end, check, s_len;
-    uint8_t data[BUFSIZE+1];
+    int32_t fd, cnt, last, end, i;
+    int32_t matches = 0;
+    int32_t max_matches = first_only ? 1 : 0x7FFFFFFF;
 
-    s_len = ece391_strlen ((uint8_t*)s);
-    if (-1 == (fd = ece391_open ((uint8_t*)fname))) {
-        ece391_fdputs (1, (uint8_t*)"file open failed\n");
+    if (-1 == (fd = ece391_open (fname))) {
+        ece391_puts ((uint8_t*)"file open failed\n");
         return -1;
     }
     last = 0;
-    while (1) {
+    do {
         cnt = ece391_read (fd, data + last, BUFSIZE - last);
-	if (-1 == cnt) {
-            ece391_fdputs (1, (uint8_t*)"file read failed\n");
+        if (-1 == cnt) {
+            ece391_puts ((uint8_t*)"file read failed\n");
             return -1;
-	}
-	last += cnt;
-	line_start = 0;
-	while (1) {
-	    line_end = line_start;
-	    while (line_end < last && '\n' != data[line_end])
-		line_end++;
-	    if ('\n' != data[line_end] && 0 != cnt && line_start != 0) {
-		/* copy from line_start to last down to 0 and fix last */
-		data[line_end] = '\0';
-		ece391_strcpy (data, data + line_start);
-		last -= line_start;
-		break;
-	    }
-	    /* search the line */
-	    data[line_end] = '\0';
-	    for (check = line_start; check < line_end; check++) {
-		if (s[0] == data[check] && 
-		    0 == ece391_strncmp ((uint8_t*)(data + check), (uint8_t*)s, s_len)) {
-		    ece391_fdputs (1, (uint8_t*)fname);
-		    ece391_fdputs (1, (uint8_t*)":");
-		    ece391_fdputs (1, data + line_start);
-		    ece391_fdputs (1, (uint8_t*)"\n");
-		    break;
-		}
-	    }
-	    line_start = line_end + 1;
-	    if (line_start >= last) {
-	        last = 0;
-		break;
-	    }
-	}
-	if (0 == cnt)
-	    break;
-    }
+        }
+        last += cnt;
+
+        /*
+         * Search up to the last newline, and carry the partial line
+         * after it over to the next read. At the end of the file, or
+         * if a single line fills the buffer, search everything.
+         */
+        for (end = last; end > 0 && '\n' != data[end - 1]; end--);
+        if (0 == cnt || 0 == end)
+            end = last;
+
+        matches += search_lines (fname, end, max_matches - matches);
+
+        for (i = end; i < last; i++)
+            data[i - end] = data[i];
+        last -= end;
+    } while (0 != cnt && matches < max_matches);
+
+    if (count_only)
+        ece391_printf ("%s:%d\n", fname, matches);
+
     if (-1 == ece391_close (fd)) {
-        ece391_fdputs (1, (uint8_t*)"file close failed\n");
+        ece391_puts ((uint8_t*)"file close failed\n");
         return -1;
     }
     return 0;
 }
 
+/*
+ * Parses the flags and splits the patterns. Returns -1 if the
+ * arguments are invalid.
+ */
+static int32_t
+parse_args (uint8_t* args)
+{
+    uint8_t* scan;
+    uint8_t flag;
+
+    while ('-' == args[0] && '\0' != args[1] &&
+           ('\0' == args[2] || ' ' == args[2])) {
+        flag = args[1];
+        args += ('\0' == args[2]) ? 2 : 3;
+        if ('c' == flag)
+            count_only = 1;
+        else if ('m' == flag)
+            first_only = 1;
+        else if ('-' == flag)
+            break;
+        else
+            return -1;
+    }
+
+    for (num_patterns = 0; num_patterns < MAX_PATTERNS; num_patterns++) {
+        for (scan = args; '\0' != *scan && '|' != *scan; scan++);
+        if (scan == args)
+            return -1;
+        if ('\0' == *scan) {
+            init_pattern (&patterns[num_patterns++], args);
+            return 0;
+        }
+        *scan = '\0';
+        init_pattern (&patterns[num_patterns], args);
+        args = scan + 1;
+    }
+
+    /* Too many patterns */
+    return -1;
+}
+
 int main ()
 {
     int32_t fd, cnt;
     uint8_t buf[SBUFSIZE];
-    uint8_t search[BUFSIZE];
+    uint8_t search[ARGSIZE];
+
+    if (0 != ece391_getargs (search, ARGSIZE)) {
+        ece391_puts ((uint8_t*)"could not read argument\n");
+        return 3;
+    }
 
-    if (0 != ece391_getargs (search, BUFSIZE)) {
-        ece391_fdputs (1, (uint8_t*)"could not read argument\n");
+    if (0 != parse_args (search)) {
+        ece391_puts ((uint8_t*)"usage: grep [-c] [-m] pattern[|pattern...]\n");
         return 3;
     }
 
     if (-1 == (fd = ece391_open ((uint8_t*)"."))) {
-        ece391_fdputs (1, (uint8_t*)"directory open failed\n");
+        ece391_puts ((uint8_t*)"directory open failed\n");
 	return 2;
     }
 
     while (0 != (cnt = ece391_read (fd, buf, SBUFSIZE-1))) {
         if (-1 == cnt) {
-	    ece391_fdputs (1, (uint8_t*)"directory entry read failed\n");
+	    ece391_puts ((uint8_t*)"directory entry read failed\n");
 	    return 3;
 	}
 	if ('.' == buf[0]) /* a directory... */
 	    continue;
 	buf[cnt] = '\0';
-	if (0 != do_one_file ((char*)search, (char*)buf))
+	if (0 != do_one_file (buf))
 	    return 3;
     }
 
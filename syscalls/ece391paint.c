@@ -56,6 +56,9 @@
 /* Number of inputs to read at once */
 #define MOUSE_BUF_SIZE 64
 
+/* Frames per second; inputs are batched up between frames */
+#define FRAME_RATE 32
+
 /* Boolean type */
 typedef uint8_t bool;
 #define true 1
@@ -82,6 +85,21 @@ typedef struct {
 
 static bool haz_interrupt = false;
 
+/* Color of each cell on the screen */
+static uint8_t canvas[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+/* Cell that the cursor is on */
+static int32_t cursor_sx = -1;
+static int32_t cursor_sy = -1;
+
+/*
+ * Cells that changed since the last frame. Only these are
+ * written to video memory when the frame is drawn.
+ */
+static bool dirty[SCREEN_HEIGHT][SCREEN_WIDTH];
+static uint16_t dirty_cells[SCREEN_HEIGHT * SCREEN_WIDTH];
+static int32_t num_dirty = 0;
+
 void
 puts(const char *s)
 {
@@ -153,34 +171,72 @@ read_mouse_inputs(int fd, mouse_input_t out[MOUSE_BUF_SIZE])
 }
 
 void
-draw_char(uint8_t *video_mem, int32_t x, int32_t y, char c)
+mark_dirty(int32_t x, int32_t y)
+{
+    if (!dirty[y][x]) {
+        dirty[y][x] = true;
+        dirty_cells[num_dirty++] = SCREEN_WIDTH * y + x;
+    }
+}
+
+void
+mark_rect_dirty(int32_t x, int32_t y, int32_t w, int32_t h)
+{
+    int32_t i, j;
+    for (i = y; i < y + h; ++i) {
+        for (j = x; j < x + w; ++j) {
+            mark_dirty(j, i);
+        }
+    }
+}
+
+void
+draw_pixel(int32_t x, int32_t y, uint8_t color)
 {
-    uint8_t *addr = &video_mem[(SCREEN_WIDTH * y + x) * 2];
-    *addr = (uint8_t)c;
+    if (canvas[y][x] != color) {
+        canvas[y][x] = color;
+        mark_dirty(x, y);
+    }
 }
 
 void
-draw_pixel(uint8_t *video_mem, int32_t x, int32_t y, uint8_t color)
+move_cursor(int32_t sx, int32_t sy)
 {
-    uint8_t *addr = &video_mem[(SCREEN_WIDTH * y + x) * 2 + 1];
-    *addr &= 0x88;
-    *addr |= (color << 4);
-    *addr |= (color);
+    if (sx == cursor_sx && sy == cursor_sy) {
+        return;
+    }
+
+    if (cursor_sx >= 0) {
+        mark_dirty(cursor_sx, cursor_sy);
+    }
+    cursor_sx = sx;
+    cursor_sy = sy;
+    mark_dirty(sx, sy);
 }
 
+/* Writes the cells that changed to video memory */
 void
-set_highlight(uint8_t *video_mem, int32_t x, int32_t y, bool highlight)
+draw_frame(uint8_t *video_mem)
 {
-    uint8_t *addr = &video_mem[(SCREEN_WIDTH * y + x) * 2 + 1];
-    if (highlight) {
-        *addr |= 0x88;
-    } else {
-        *addr &= 0x77;
+    uint16_t *cells = (uint16_t *)video_mem;
+    int32_t i;
+    for (i = 0; i < num_dirty; ++i) {
+        int32_t x = dirty_cells[i] % SCREEN_WIDTH;
+        int32_t y = dirty_cells[i] / SCREEN_WIDTH;
+        uint8_t color = canvas[y][x];
+        uint8_t attrib = (color << 4) | color;
+        bool highlight = (x == cursor_sx && y == cursor_sy) ? HIGHLIGHT_FG : HIGHLIGHT_BG;
+        if (highlight) {
+            attrib |= 0x88;
+        }
+        cells[dirty_cells[i]] = (attrib << 8) | ' ';
+        dirty[y][x] = false;
     }
+    num_dirty = 0;
 }
 
 void
-draw_palette(uint8_t *video_mem)
+draw_palette(void)
 {
     int32_t i, j, k;
     for (i = 0; i < NUM_COLORS; ++i) {
@@ -188,8 +244,7 @@ draw_palette(uint8_t *video_mem)
             for (k = 0; k < PALETTE_HEIGHT; ++k) {
                 int32_t x = PALETTE_WIDTH * i + j;
                 int32_t y = SCREEN_HEIGHT - PALETTE_HEIGHT + k;
-                draw_pixel(video_mem, x, y, i);
-                set_highlight(video_mem, x, y, HIGHLIGHT_BG);
+                draw_pixel(x, y, i);
             }
         }
     }
@@ -213,16 +268,15 @@ update_palette(int32_t sx, int32_t sy, uint8_t *selected_color)
 }
 
 void
-clear_screen(uint8_t *video_mem, uint8_t color)
+clear_screen(uint8_t color)
 {
     int32_t i, j;
     for (i = 0; i < SCREEN_HEIGHT; ++i) {
         for (j = 0; j < SCREEN_WIDTH; ++j) {
-            draw_char(video_mem, j, i, ' ');
-            draw_pixel(video_mem, j, i, color);
-            set_highlight(video_mem, j, i, HIGHLIGHT_BG);
+            canvas[i][j] = color;
         }
     }
+    mark_rect_dirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 }
 
 void
@@ -288,9 +342,13 @@ main(void)
         return 1;
     }
 
-    /* Clear the screen and draw the palette */
-    clear_screen(video_mem, COLOR_BG);
-    draw_palette(video_mem);
+    /* Frames are paced by the RTC */
+    int rtc_fd = ece391_open((uint8_t *)"rtc");
+    int32_t rate = FRAME_RATE;
+    if (rtc_fd < 0 || ece391_write(rtc_fd, &rate, sizeof(rate)) < 0) {
+        puts("Could not open RTC file\n");
+        return 1;
+    }
 
     /* Some state variables... */
     int32_t prev_cx = CANVAS_WIDTH / 2;
@@ -298,51 +356,54 @@ main(void)
     uint8_t selected_color = COLOR_RED;
     mouse_input_t inputs[MOUSE_BUF_SIZE];
 
+    /* Clear the screen and draw the palette and cursor */
+    int32_t new_sx, new_sy;
+    clear_screen(COLOR_BG);
+    draw_palette();
+    canvas_to_screen(prev_cx, prev_cy, &new_sx, &new_sy);
+    move_cursor(new_sx, new_sy);
+
     while (1) {
+        /* Draw whatever changed, then wait for the next frame */
+        draw_frame(video_mem);
+        ece391_read(rtc_fd, &rate, sizeof(rate));
+
         /* If user pressed CTRL-C, reset the screen and exit */
         if (haz_interrupt) {
             reset_screen(video_mem);
             break;
         }
 
-        /* Read some more mouse inputs */
-        int32_t num_inputs = read_mouse_inputs(mouse_fd, inputs);
-        if (num_inputs == 0) {
-            continue;
-        }
-
-        int32_t i;
-        for (i = 0; i < num_inputs; ++i) {
-            mouse_input_t input = inputs[i];
-
-            /* Undraw cursor at old location */
-            int32_t prev_sx, prev_sy;
-            canvas_to_screen(prev_cx, prev_cy, &prev_sx, &prev_sy);
-            set_highlight(video_mem, prev_sx, prev_sy, HIGHLIGHT_BG);
-
-            /* Compute new canvas location */
-            int32_t new_cx = prev_cx + input.dx * MOUSE_SPEED;
-            int32_t new_cy = prev_cy + input.dy * MOUSE_SPEED;
-            clamp_coords(&new_cx, &new_cy);
-
-            /* Draw cursor at new location */
-            int32_t new_sx, new_sy;
-            canvas_to_screen(new_cx, new_cy, &new_sx, &new_sy);
-            set_highlight(video_mem, new_sx, new_sy, HIGHLIGHT_FG);
-
-            /* Draw/erase pixel under cursor */
-            if (input.left) {
-                if (!update_palette(new_sx, new_sy, &selected_color)) {
-                    draw_pixel(video_mem, new_sx, new_sy, selected_color);
-                }
-            } else if (input.right) {
-                if (!update_palette(new_sx, new_sy, NULL)) {
-                    draw_pixel(video_mem, new_sx, new_sy, COLOR_BG);
+        /* Apply all the mouse inputs since the last frame */
+        int32_t num_inputs;
+        while ((num_inputs = read_mouse_inputs(mouse_fd, inputs)) > 0) {
+            int32_t i;
+            for (i = 0; i < num_inputs; ++i) {
+                mouse_input_t input = inputs[i];
+
+                /* Compute new canvas location */
+                int32_t new_cx = prev_cx + input.dx * MOUSE_SPEED;
+                int32_t new_cy = prev_cy + input.dy * MOUSE_SPEED;
+                clamp_coords(&new_cx, &new_cy);
+                canvas_to_screen(new_cx, new_cy, &new_sx, &new_sy);
+
+                /* Draw/erase pixel under cursor */
+                if (input.left) {
+                    if (!update_palette(new_sx, new_sy, &selected_color)) {
+                        draw_pixel(new_sx, new_sy, selected_color);
+                    }
+                } else if (input.right) {
+                    if (!update_palette(new_sx, new_sy, NULL)) {
+                        draw_pixel(new_sx, new_sy, COLOR_BG);
+                    }
                 }
+
+                prev_cx = new_cx;
+                prev_cy = new_cy;
             }
 
-            prev_cx = new_cx;
-            prev_cy = new_cy;
+            /* Only the final cursor position gets drawn */
+            move_cursor(new_sx, new_sy);
         }
     }
 
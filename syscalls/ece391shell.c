@@ -4,33 +4,261 @@
 #include "ece391syscall.h"
 
 #define BUFSIZE 1024
+#define SBUFSIZE 33
+
+/* The filesystem has at most 63 entries; the table is twice that */
+#define MAX_CMDS 64
+#define CMD_TABLE_SIZE 128
+
+/* How deeply scripts may source other scripts */
+#define MAX_SCRIPT_DEPTH 8
+
+/*
+ * Command cache. The filesystem is read-only, so the directory is
+ * read once at startup; commands that aren't in it are rejected
+ * without a trip through execute, and ls is answered from here.
+ * This is only a negative cache: a hit still goes to execute by
+ * name, which looks the file up in the kernel again.
+ */
+static uint8_t cmd_names[MAX_CMDS][SBUFSIZE];
+static int32_t num_cmds;
+static int8_t cmd_table[CMD_TABLE_SIZE];
+
+static int32_t script_depth;
+
+static int32_t run_command (uint8_t* cmd);
+
+static uint32_t
+hash_name (const uint8_t* name, int32_t len)
+{
+    uint32_t hash = 5381;
+    int32_t i;
+
+    for (i = 0; i < len; i++)
+        hash = hash * 33 + name[i];
+    return hash;
+}
+
+/* Looks up the first len chars of name; returns its index or -1 */
+static int32_t
+cache_lookup (const uint8_t* name, int32_t len)
+{
+    uint32_t slot = hash_name (name, len) % CMD_TABLE_SIZE;
+    int32_t idx;
+
+    for (; -1 != (idx = cmd_table[slot]); slot = (slot + 1) % CMD_TABLE_SIZE) {
+        if (0 == ece391_strncmp (cmd_names[idx], name, len) &&
+            '\0' == cmd_names[idx][len])
+            return idx;
+    }
+    return -1;
+}
+
+static void
+cache_init (void)
+{
+    int32_t fd, cnt, i;
+    uint32_t slot;
+
+    for (i = 0; i < CMD_TABLE_SIZE; i++)
+        cmd_table[i] = -1;
+
+    if (-1 == (fd = ece391_open ((uint8_t*)".")))
+        return;
+    while (num_cmds < MAX_CMDS &&
+           0 < (cnt = ece391_read (fd, cmd_names[num_cmds], SBUFSIZE - 1))) {
+        cmd_names[num_cmds][cnt] = '\0';
+        slot = hash_name (cmd_names[num_cmds], cnt) % CMD_TABLE_SIZE;
+        while (-1 != cmd_table[slot])
+            slot = (slot + 1) % CMD_TABLE_SIZE;
+        cmd_table[slot] = num_cmds++;
+    }
+    (void)ece391_close (fd);
+}
+
+/* Prints a time in ticks as seconds */
+static void
+print_seconds (const uint8_t* label, uint32_t ticks, uint32_t ticks_per_sec)
+{
+    uint32_t centis = ticks * 100 / ticks_per_sec;
+
+    ece391_printf ("%s %u.%02us", label, centis / 100, centis % 100);
+}
+
+/* Runs a command and reports how long it took */
+static int32_t
+time_command (uint8_t* cmd)
+{
+    times_t start, end;
+    int32_t rval;
+
+    if (-1 == ece391_times (&start)) {
+        ece391_puts ((uint8_t*)"could not read times\n");
+        return -1;
+    }
+    rval = run_command (cmd);
+    (void)ece391_times (&end);
+
+    print_seconds ((uint8_t*)"real", end.elapsed - start.elapsed,
+                   end.ticks_per_sec);
+    print_seconds ((uint8_t*)"  cpu",
+                   end.cpu + end.child_cpu - start.cpu - start.child_cpu,
+                   end.ticks_per_sec);
+    ece391_putc ('\n');
+    return rval;
+}
+
+/*
+ * Runs each line of a file as a command. Empty lines and lines
+ * starting with '#' are skipped. Lines that don't fit in the
+ * buffer are reported and skipped rather than split in two.
+ * Returns the status of the last command.
+ */
+static int32_t
+run_script (const uint8_t* fname)
+{
+    uint8_t buf[BUFSIZE];
+    int32_t fd, cnt, last, start, end;
+    int32_t skip = 0;
+    int32_t rval = 0;
+
+    if (MAX_SCRIPT_DEPTH <= script_depth) {
+        ece391_puts ((uint8_t*)"scripts nested too deeply\n");
+        return -1;
+    }
+    if (-1 == (fd = ece391_open (fname))) {
+        ece391_puts ((uint8_t*)"script not found\n");
+        return -1;
+    }
+
+    script_depth++;
+    last = 0;
+    do {
+        cnt = ece391_read (fd, buf + last, BUFSIZE - 1 - last);
+        if (-1 == cnt) {
+            ece391_puts ((uint8_t*)"script read failed\n");
+            rval = -1;
+            break;
+        }
+        last += cnt;
+
+        /* Run every complete line, plus the last one at the end */
+        for (start = 0; start < last; start = end + 1) {
+            for (end = start; end < last && '\n' != buf[end]; end++);
+            if (end == last && 0 != cnt)
+                break;
+            buf[end] = '\0';
+            if (skip)
+                skip = 0;
+            else if ('#' != buf[start])
+                rval = run_command (buf + start);
+        }
+        if (start > last)
+            start = last;
+
+        /* A partial line that fills the buffer is too long */
+        if (0 == start && BUFSIZE - 1 == last) {
+            if (!skip) {
+                ece391_puts ((uint8_t*)"script line too long\n");
+                rval = -1;
+            }
+            skip = 1;
+            start = last;
+        }
+
+        /* Keep the partial line for the next read */
+        for (end = start; end < last; end++)
+            buf[end - start] = buf[end];
+        last -= start;
+    } while (0 != cnt);
+    script_depth--;
+
+    (void)ece391_close (fd);
+    return rval;
+}
+
+/*
+ * Runs a command line, either as a built-in or a program.
+ * Returns the exit status.
+ */
+static int32_t
+run_command (uint8_t* cmd)
+{
+    uint8_t* args;
+    int32_t len, rval, i;
+
+    while (' ' == *cmd)
+        cmd++;
+    for (len = 0; '\0' != cmd[len] && ' ' != cmd[len]; len++);
+    for (args = cmd + len; ' ' == *args; args++);
+
+    if (0 == len)
+        return 0;
+
+    if (4 == len && 0 == ece391_strncmp (cmd, (uint8_t*)"exit", len)) {
+        (void)ece391_flush ();
+        (void)ece391_halt (0);
+    }
+    if (4 == len && 0 == ece391_strncmp (cmd, (uint8_t*)"echo", len)) {
+        ece391_puts (args);
+        ece391_putc ('\n');
+        return 0;
+    }
+    if (2 == len && 0 == ece391_strncmp (cmd, (uint8_t*)"ls", len)) {
+        for (i = 0; i < num_cmds; i++) {
+            ece391_puts (cmd_names[i]);
+            ece391_putc ('\n');
+        }
+        return 0;
+    }
+    if (2 == len && 0 == ece391_strncmp (cmd, (uint8_t*)"cd", len)) {
+        /* There's only one directory */
+        return 0;
+    }
+    if (4 == len && 0 == ece391_strncmp (cmd, (uint8_t*)"time", len))
+        return time_command (args);
+    if (6 == len && 0 == ece391_strncmp (cmd, (uint8_t*)"source", len))
+        return run_script (args);
+
+    if (0 < num_cmds && -1 == cache_lookup (cmd, len)) {
+        ece391_puts ((uint8_t*)"no such command\n");
+        return -1;
+    }
+
+    (void)ece391_flush ();
+    rval = ece391_execute (cmd);
+    if (-1 == rval)
+        ece391_puts ((uint8_t*)"no such command\n");
+    else if (256 == rval)
+        ece391_puts ((uint8_t*)"program terminated by exception\n");
+    else if (0 != rval)
+        ece391_puts ((uint8_t*)"program terminated abnormally\n");
+    return rval;
+}
 
 int main ()
 {
-    int32_t cnt, rval;
+    int32_t cnt;
     uint8_t buf[BUFSIZE];
-    ece391_fdputs (1, (uint8_t*)"Starting 391 Shell\n");
+
+    cache_init ();
+
+    /* With an argument, run it as a script and exit */
+    if (0 == ece391_getargs (buf, BUFSIZE) && '\0' != buf[0])
+        return run_script (buf) & 0xFF;
+
+    ece391_puts ((uint8_t*)"Starting 391 Shell\n");
 
     while (1) {
-        ece391_fdputs (1, (uint8_t*)"loliOS> ");
+        ece391_puts ((uint8_t*)"loliOS> ");
+	(void)ece391_flush ();
 	if (-1 == (cnt = ece391_read (0, buf, BUFSIZE-1))) {
-	    ece391_fdputs (1, (uint8_t*)"read from keyboard failed\n");
+	    ece391_puts ((uint8_t*)"read from keyboard failed\n");
 	    return 3;
 	}
 	if (cnt > 0 && '\n' == buf[cnt - 1])
 	    cnt--;
 	buf[cnt] = '\0';
-	if (0 == ece391_strcmp (buf, (uint8_t*)"exit"))
-	    return 0;
-	if ('\0' == buf[0])
-	    continue;
-	rval = ece391_execute (buf);
-	if (-1 == rval)
-	    ece391_fdputs (1, (uint8_t*)"no such command\n");
-	else if (256 == rval)
-	    ece391_fdputs (1, (uint8_t*)"program terminated by exception\n");
-	else if (0 != rval)
-	    ece391_fdputs (1, (uint8_t*)"program terminated abnormally\n");
+	(void)run_command (buf);
     }
 }
-
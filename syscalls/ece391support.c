@@ -1,28 +1,84 @@
+#include <stdarg.h>
 #include <stdint.h>
 
 #include "ece391support.h"
 #include "ece391syscall.h"
 
+/*
+ * The string functions work a word at a time where they can.
+ * HAS_ZERO(w) is nonzero if any byte of w is zero. Only aligned
+ * words are read, so reading past the terminator never crosses
+ * into an unmapped page.
+ */
+#define WORD_SIZE 4
+#define WORD_ONES  0x01010101
+#define WORD_HIGHS 0x80808080
+#define HAS_ZERO(w) (((w) - WORD_ONES) & ~(w) & WORD_HIGHS)
+#define ALIGNED(p) (((uint32_t)(p) & (WORD_SIZE - 1)) == 0)
+
+typedef uint32_t __attribute__((may_alias)) word_t;
+typedef uint32_t __attribute__((may_alias, aligned(1))) uword_t;
+
 uint32_t ece391_strlen(const uint8_t* s)
 {
-    uint32_t len;
+    const uint8_t* p = s;
+    const word_t* w;
 
-    for (len = 0; '\0' != *s; s++, len++);
-    return len;
+    for (; !ALIGNED(p); p++)
+        if ('\0' == *p)
+            return p - s;
+    for (w = (const word_t*)p; !HAS_ZERO(*w); w++);
+    for (p = (const uint8_t*)w; '\0' != *p; p++);
+    return p - s;
 }
 
 void ece391_strcpy(uint8_t* dst, const uint8_t* src)
 {
+    const word_t* w;
+
+    for (; !ALIGNED(src); dst++, src++)
+        if ('\0' == (*dst = *src))
+            return;
+    for (w = (const word_t*)src; !HAS_ZERO(*w); w++, dst += WORD_SIZE)
+        *(uword_t*)dst = *w;
+    src = (const uint8_t*)w;
     while ('\0' != (*dst++ = *src++));
 }
 
+void* ece391_memchr(const void* s, int32_t c, uint32_t n)
+{
+    const uint8_t* p = s;
+    uint8_t ch = c;
+    uint32_t pattern = ch * WORD_ONES;
+
+    for (; n > 0 && !ALIGNED(p); p++, n--)
+        if (ch == *p)
+            return (void*)p;
+    for (; n >= WORD_SIZE; p += WORD_SIZE, n -= WORD_SIZE)
+        if (HAS_ZERO(*(const word_t*)p ^ pattern))
+            break;
+    for (; n > 0; p++, n--)
+        if (ch == *p)
+            return (void*)p;
+    return 0;
+}
+
 void ece391_fdputs(int32_t fd, const uint8_t* s)
 {
+    /* Keep anything already buffered in order */
+    (void)ece391_flush ();
     (void)ece391_write (fd, s, ece391_strlen(s));
 }
 
 int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2)
 {
+    if (ALIGNED((uint32_t)s1 ^ (uint32_t)s2)) {
+        for (; !ALIGNED(s1); s1++, s2++)
+            if (*s1 != *s2 || '\0' == *s1)
+                return ((int32_t)*s1) - ((int32_t)*s2);
+        for (; *(const word_t*)s1 == *(const word_t*)s2 &&
+               !HAS_ZERO(*(const word_t*)s1); s1 += WORD_SIZE, s2 += WORD_SIZE);
+    }
     while (*s1 == *s2) {
         if (*s1 == '\0')
             return 0;
@@ -36,11 +92,19 @@ int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n)
 {
     if (0 == n)
         return 0;
+    if (ALIGNED((uint32_t)s1 ^ (uint32_t)s2)) {
+        for (; !ALIGNED(s1); s1++, s2++)
+            if (*s1 != *s2 || '\0' == *s1 || --n == 0)
+                return ((int32_t)*s1) - ((int32_t)*s2);
+        for (; n > WORD_SIZE && *(const word_t*)s1 == *(const word_t*)s2 &&
+               !HAS_ZERO(*(const word_t*)s1); s1 += WORD_SIZE, s2 += WORD_SIZE)
+            n -= WORD_SIZE;
+    }
     while (*s1 == *s2) {
         if (*s1 == '\0' || --n == 0)
-        return 0;
-    s1++;
-    s2++;
+            return 0;
+        s1++;
+        s2++;
     }
     return ((int32_t)*s1) - ((int32_t)*s2);
 }
@@ -102,3 +166,158 @@ uint8_t* ece391_strrev(uint8_t* s)
    return s;
 }
 
+
+/*
+ * Buffered standard output. Output collects here until the buffer
+ * fills, a newline is written in line-buffered mode, ece391_flush
+ * is called, or main returns.
+ */
+static uint8_t out_buf[ECE391_OUTBUF_SIZE];
+static int32_t out_len = 0;
+static int32_t out_mode = ECE391_BUF_FULL;
+
+void ece391_setbuf_mode(int32_t mode)
+{
+    (void)ece391_flush ();
+    out_mode = mode;
+}
+
+int32_t ece391_flush(void)
+{
+    int32_t len = out_len;
+
+    out_len = 0;
+    if (0 < len && -1 == ece391_write (1, out_buf, len))
+        return -1;
+    return 0;
+}
+
+void ece391_putc(uint8_t c)
+{
+    out_buf[out_len++] = c;
+    if (ECE391_OUTBUF_SIZE == out_len ||
+        (ECE391_BUF_LINE == out_mode && '\n' == c))
+        (void)ece391_flush ();
+}
+
+void ece391_putbuf(const void* buf, int32_t n)
+{
+    const uint8_t* p = buf;
+    int32_t flush = ECE391_BUF_LINE == out_mode &&
+                    0 != ece391_memchr (buf, '\n', n);
+
+    /* Big writes gain nothing from a trip through the buffer */
+    if (ECE391_OUTBUF_SIZE <= n) {
+        (void)ece391_flush ();
+        (void)ece391_write (1, buf, n);
+        return;
+    }
+
+    for (; 0 < n; p++, n--) {
+        out_buf[out_len++] = *p;
+        if (ECE391_OUTBUF_SIZE == out_len)
+            (void)ece391_flush ();
+    }
+    if (flush)
+        (void)ece391_flush ();
+}
+
+void ece391_puts(const uint8_t* s)
+{
+    ece391_putbuf (s, ece391_strlen (s));
+}
+
+/* Pads a field out to the given width */
+static int32_t printf_pad(int32_t len, int32_t width, uint8_t pad)
+{
+    int32_t count = 0;
+
+    for (; len + count < width; count++)
+        ece391_putc (pad);
+    return count;
+}
+
+/*
+ * Formats to the stdout buffer. Supports %s, %c, %d, %u and %x
+ * (plus %%), with an optional '-' or '0' flag and a field width.
+ * Returns the number of characters written.
+ */
+int32_t ece391_printf(const char* format, ...)
+{
+    va_list args;
+    uint8_t num[12];
+    const uint8_t* str;
+    int32_t count, len, width, left;
+    uint8_t pad;
+    int32_t val;
+
+    va_start (args, format);
+    for (count = 0; '\0' != *format; format++) {
+        if ('%' != *format) {
+            ece391_putc (*format);
+            count++;
+            continue;
+        }
+
+        left = 0;
+        pad = ' ';
+        for (format++; '-' == *format || '0' == *format; format++) {
+            if ('-' == *format)
+                left = 1;
+            else
+                pad = '0';
+        }
+        for (width = 0; '0' <= *format && '9' >= *format; format++)
+            width = width * 10 + *format - '0';
+
+        switch (*format) {
+        case 's':
+            str = va_arg (args, const uint8_t*);
+            break;
+        case 'c':
+            num[0] = va_arg (args, int32_t);
+            num[1] = '\0';
+            str = num;
+            break;
+        case 'd':
+            val = va_arg (args, int32_t);
+            if (0 > val) {
+                num[0] = '-';
+                ece391_itoa (-(uint32_t)val, num + 1, 10);
+            } else {
+                ece391_itoa (val, num, 10);
+            }
+            str = num;
+            break;
+        case 'u':
+            str = ece391_itoa (va_arg (args, uint32_t), num, 10);
+            break;
+        case 'x':
+            str = ece391_itoa (va_arg (args, uint32_t), num, 16);
+            break;
+        case '\0':
+            format--;
+            /* fall through */
+        default:
+            str = (const uint8_t*)"%";
+            break;
+        }
+
+        len = ece391_strlen (str);
+        if ('0' == pad && '-' == *str) {
+            ece391_putc (*str++);
+            count++;
+            len--;
+            width--;
+        }
+        if (!left)
+            count += printf_pad (len, width, pad);
+        ece391_putbuf (str, len);
+        count += len;
+        if (left)
+            count += printf_pad (len, width, ' ');
+    }
+    va_end (args);
+
+    return count;
+}
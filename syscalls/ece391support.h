@@ -3,11 +3,29 @@
 
 extern uint32_t ece391_strlen(const uint8_t* s);
 extern void ece391_strcpy(uint8_t* dst, const uint8_t* src);
+extern void* ece391_memchr(const void* s, int32_t c, uint32_t n);
 extern void ece391_fdputs(int32_t fd, const uint8_t* s);
 extern int32_t ece391_strcmp(const uint8_t* s1, const uint8_t* s2);
 extern int32_t ece391_strncmp(const uint8_t* s1, const uint8_t* s2, uint32_t n);
 extern uint8_t *ece391_itoa(uint32_t value, uint8_t* buf, int32_t radix);
 extern uint8_t *ece391_strrev(uint8_t* s);
 
+/*
+ * Buffered standard output. Anything written here stays in a buffer
+ * until it fills, ece391_flush is called, or main returns; in
+ * line-buffered mode, a newline also flushes. ece391_fdputs flushes
+ * before writing, so the two can be mixed.
+ */
+#define ECE391_OUTBUF_SIZE 1024
+#define ECE391_BUF_FULL 0
+#define ECE391_BUF_LINE 1
+
+extern void ece391_setbuf_mode(int32_t mode);
+extern int32_t ece391_flush(void);
+extern void ece391_putc(uint8_t c);
+extern void ece391_putbuf(const void* buf, int32_t n);
+extern void ece391_puts(const uint8_t* s);
+extern int32_t ece391_printf(const char* format, ...);
+
 #endif /* ECE391SUPPORT_H */
 
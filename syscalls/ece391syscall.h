@@ -19,9 +19,79 @@ extern int32_t ece391_open (const uint8_t* filename);
 extern int32_t ece391_close (int32_t fd);
 extern int32_t ece391_getargs (uint8_t* buf, int32_t nbytes);
 extern int32_t ece391_vidmap (uint8_t** screen_start);
+
+/*
+ * Like vidmap, but the mapped page is a back buffer that is only shown
+ * when present is called. present waits for the next frame, flips the
+ * pages, and leaves a copy of the new screen in the back buffer.
+ */
+extern int32_t ece391_vidmap_buffered (uint8_t** screen_start);
+extern int32_t ece391_present (void);
 extern int32_t ece391_set_handler (int32_t signum, void* handler);
 extern int32_t ece391_sigreturn (void);
 
+/*
+ * Graphics. set_video_mode switches to a width x height, 32 bits per
+ * pixel mode (width must be a multiple of 8), or back to text mode if
+ * both are 0. blit copies rect->w x rect->h pixels to the screen; with
+ * BLIT_PRESENT in a double-buffered mode, the finished frame is shown.
+ */
+#define VIDEO_MODE_DOUBLE_BUFFER 0x1
+#define BLIT_PRESENT 0x1
+
+typedef struct {
+	int32_t x;
+	int32_t y;
+	int32_t w;
+	int32_t h;
+} blit_rect_t;
+
+extern int32_t ece391_set_video_mode (uint32_t width, uint32_t height, uint32_t flags);
+extern int32_t ece391_blit (const uint32_t* pixels, const blit_rect_t* rect, uint32_t flags);
+
+/*
+ * Copies rect->w x rect->h text cells (character in the low byte,
+ * attribute in the high byte) to column rect->x, row rect->y of the
+ * terminal. The cursor does not move and the screen does not scroll.
+ */
+extern int32_t ece391_cell_blit (const uint16_t* cells, const blit_rect_t* rect);
+
+/*
+ * Reports times in scheduler ticks: since boot, spent running this
+ * process, and spent running its children that have halted.
+ */
+typedef struct {
+	uint32_t elapsed;
+	uint32_t cpu;
+	uint32_t child_cpu;
+	uint32_t ticks_per_sec;
+} times_t;
+
+extern int32_t ece391_times (times_t* buf);
+
+/*
+ * Sets the base of this process's GS segment, so that %gs:0 is the
+ * byte at base. GS is set up for it on return, and stays set up
+ * across signal handlers.
+ */
+extern int32_t ece391_set_tls (void* base);
+
+/*
+ * User-space drivers. ioperm gives this process direct access to the
+ * I/O ports from through from + num - 1 (or takes it away, if turn_on
+ * is 0). Only ports below 0x400 can be used, and never those of the
+ * devices the kernel drives (interrupt controllers, timer, keyboard
+ * and mouse, RTC, serial port, VGA and VBE). Write ESC [ row ; col H
+ * to move the text cursor, and ESC [ ? 25 l or h to hide or show it.
+ *
+ * The "irq" device forwards an IRQ line: write the IRQ number to it
+ * (as an int32_t) to claim the line, then each read waits for an
+ * interrupt and returns how many came in since the last read (as a
+ * uint32_t). The line stays masked until the next read, so service
+ * the device before reading again. Closing the file frees the line.
+ */
+extern int32_t ece391_ioperm (uint32_t from, uint32_t num, int32_t turn_on);
+
 enum signums {
 	DIV_ZERO = 0,
 	SEGFAULT,
@@ -11,5 +11,13 @@
 #define SYS_VIDMAP  8
 #define SYS_SET_HANDLER  9
 #define SYS_SIGRETURN  10
+#define SYS_SET_VIDEO_MODE 11
+#define SYS_BLIT       12
+#define SYS_VIDMAP_BUFFERED 13
+#define SYS_PRESENT    14
+#define SYS_CELL_BLIT  15
+#define SYS_TIMES      16
+#define SYS_SET_TLS    17
+#define SYS_IOPERM     18
 
 #endif /* ECE391SYSNUM_H */